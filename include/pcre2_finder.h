@@ -73,7 +73,7 @@
 /*! \brief major version number */
 #define PCRE2_FINDER_VERSION_MAJOR 0
 /*! \brief minor version number */
-#define PCRE2_FINDER_VERSION_MINOR 1
+#define PCRE2_FINDER_VERSION_MINOR 2
 /*! \brief micro version number */
 #define PCRE2_FINDER_VERSION_MICRO 0
 /*! @} */
@@ -92,6 +92,50 @@
 /*! \brief string with name and version of library \hideinitializer */
 #define PCRE2_FINDER_FULLNAME PCRE2_FINDER_NAME " " PCRE2_FINDER_VERSION_STRING
 
+/*! \brief matching engines
+ * \sa     pcre2_finder_set_engine()
+ * \name   PCRE2_FINDER_ENGINE_*
+ * \{
+ */
+/*! \brief match using pcre2_dfa_match() returning the shortest match (default) */
+#define PCRE2_FINDER_ENGINE_DFA 0
+/*! \brief match using JIT compiled pcre2_jit_match() (Perl-compatible leftmost match), falls back to PCRE2_FINDER_ENGINE_DFA if JIT is not available */
+#define PCRE2_FINDER_ENGINE_JIT 1
+/*! @} */
+
+/*! \brief search modes
+ * \sa     pcre2_finder_set_mode()
+ * \name   PCRE2_FINDER_MODE_*
+ * \{
+ */
+/*! \brief each expression is searched in a separate pass on the output of the previous expression (default) */
+#define PCRE2_FINDER_MODE_LAYERED 0
+/*! \brief consecutive expressions with the same flags and engine are combined and searched in a single pass */
+#define PCRE2_FINDER_MODE_SIMULTANEOUS 1
+/*! @} */
+
+/*! \brief returned by pcre2_finder_process() and pcre2_finder_close() after a match function or batch function returned non-zero
+ * \sa     pcre2_finder_match_fn
+ * \sa     pcre2_finder_batch_fn
+ */
+#define PCRE2_FINDER_ABORTED 1
+
+/*! \brief policies when a search hits a limit
+ * \sa     pcre2_finder_set_limit_policy()
+ * \name   PCRE2_FINDER_LIMIT_*
+ * \{
+ */
+/*! \brief pcre2_finder_process() returns the error (default) */
+#define PCRE2_FINDER_LIMIT_FAIL 0
+/*! \brief the data the expression didn't finish searching is treated as non-matching data and searching continues with the next data */
+#define PCRE2_FINDER_LIMIT_SKIP 1
+/*! @} */
+
+/*! \brief returned by pcre2_finder_process() when an expression exceeded its time limit
+ * \sa     pcre2_finder_set_time_limit()
+ */
+#define PCRE2_FINDER_ERROR_TIMELIMIT -1000
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -119,14 +163,32 @@ struct pcre2_finder;
  * \param  datalen         match data length
  * \param  callbackdata    custom data as passed to pcre2_finder_add_expr()
  * \param  matchid         match id as specified in pcre2_finder_add_expr()
- * \return zero to continue, or non-zero to abort further matching
+ * \return zero to continue, or non-zero to abort further matching by all expressions (see PCRE2_FINDER_ABORTED)
  * \sa     pcre2_finder_add_expr()
  * \sa     pcre2_finder_open()
  * \sa     pcre2_finder_process()
+ * \sa     pcre2_finder_get_match_offset()
  */
-//typedef int (*pcre2_finder_match_fn)(unsigned int id, unsigned long long from, unsigned long long to, unsigned int flags, struct pcre2_finder* finder);
 typedef int (*pcre2_finder_match_fn)(struct pcre2_finder* finder, const char* data, size_t datalen, void* callbackdata, int matchid);
 
+/*! \brief match collected in a batch, see pcre2_finder_set_match_batch() */
+struct pcre2_finder_match {
+  const char* data;                     /*!< match data (not NULL terminated) */
+  size_t datalen;                       /*!< match data length */
+  unsigned long long offset;            /*!< offset of the match from the start of the stream, see pcre2_finder_get_match_offset() */
+  int matchid;                          /*!< match id as specified in pcre2_finder_add_expr() */
+};
+
+/*! \brief type of pointer to function for processing a batch of matches
+ * \param  finder          pcre2_finder object passed to pcre2_finder_process() or pcre2_finder_close()
+ * \param  matches         matches in the order they were found
+ * \param  count           number of matches
+ * \param  callbackdata    custom data as passed to pcre2_finder_set_match_batch()
+ * \return zero to continue, or non-zero to abort further matching by all expressions (see PCRE2_FINDER_ABORTED)
+ * \sa     pcre2_finder_set_match_batch()
+ */
+typedef int (*pcre2_finder_batch_fn)(struct pcre2_finder* finder, const struct pcre2_finder_match* matches, size_t count, void* callbackdata);
+
 /*! \brief type of pointer to function for processing output (called for all non-matching data)
  * \param  callbackdata    custom data as passed to pcre2_finder_open()
  * \param  data            data to be processed
@@ -135,6 +197,11 @@ typedef int (*pcre2_finder_match_fn)(struct pcre2_finder* finder, const char* da
  * \sa     pcre2_finder_open()
  * \sa     pcre2_finder_process()
  * \sa     pcre2_finder_output_to_stream()
+ *
+ * \p data points into the data passed to pcre2_finder_process(), into data passed to pcre2_finder_output() or into
+ * internal buffers. Data from internal buffers stays valid until the function is called with \p data set to NULL
+ * and \p datalen set to 0, which is done before the finder overwrites these buffers. Output functions that keep
+ * references to the data instead of consuming it right away must release them at that point.
  */
 typedef size_t (*pcre2_finder_output_fn) (void* callbackdata, const char* data, size_t datalen);
 
@@ -159,10 +226,206 @@ DLL_EXPORT_PCRE2_FINDER void pcre2_finder_cleanup (struct pcre2_finder* finder);
  * \param  matchid         match id to pass to matchfn
  * \return zero on success
  * \sa     pcre2_finder_initialize()
+ * \sa     pcre2_finder_set_engine()
+ *
+ * In simultaneous mode literal expressions (compiled with PCRE2_LITERAL or without any metacharacters other than
+ * escaped punctuation) are searched with an Aho-Corasick automaton instead of PCRE2, consecutive literal expressions
+ * with the same flags share the same automaton. PCRE2_CASELESS is supported for ASCII letters. In layered mode
+ * literal expressions are compiled by PCRE2 like other expressions, as PCRE2 finds a single literal faster.
+ * \sa     pcre2_finder_set_mode()
  * \sa     pcre2_finder_process()
  */
 DLL_EXPORT_PCRE2_FINDER int pcre2_finder_add_expr (struct pcre2_finder* finder, const char* expr, unsigned int flags, pcre2_finder_match_fn matchfn, void* callbackdata, int matchid);
 
+/*! \brief set matching engine for search expressions added after this call
+ * \param  finder          pcre2_finder object
+ * \param  engine          matching engine (PCRE2_FINDER_ENGINE_*)
+ * \return zero on success
+ * \sa     pcre2_finder_add_expr()
+ * \sa     pcre2_finder_jit_available()
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_set_engine (struct pcre2_finder* finder, int engine);
+
+/*! \brief set search mode for search expressions added after this call
+ * \param  finder          pcre2_finder object
+ * \param  mode            search mode (PCRE2_FINDER_MODE_*)
+ * \return zero on success
+ * \sa     pcre2_finder_add_expr()
+ *
+ * In simultaneous mode consecutive expressions are combined into one alternation, which is compiled by
+ * pcre2_finder_open() and searched with pcre2_match() (JIT compiled if PCRE2_FINDER_ENGINE_JIT was selected).
+ * At each position the leftmost match wins, and when several expressions match at the same position the one
+ * added first wins. Unlike layered mode the output of one expression is not searched by the other expressions.
+ * Capturing groups are numbered per expression, but group names must be unique within the combined expressions.
+ * Literal expressions are combined separately from other expressions (see pcre2_finder_add_expr()).
+ * Expressions containing backtracking control verbs like (*MARK) or (*PRUNE) are not combined but searched on their
+ * own with pcre2_match(), as they would interfere with how the combined expressions are searched.
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_set_mode (struct pcre2_finder* finder, int mode);
+
+/*! \brief set maximum size of partial matches carried over between chunks for search expressions added after this call
+ * \param  finder          pcre2_finder object
+ * \param  maxsize         maximum number of bytes kept while a match is in progress (0 for no limit, which is the default)
+ * \sa     pcre2_finder_add_expr()
+ * \sa     pcre2_finder_process()
+ *
+ * When a partial match grows beyond \p maxsize it is abandoned and its data is output as non-matching data.
+ */
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_max_partial_match (struct pcre2_finder* finder, size_t maxsize);
+
+/*! \brief declare maximum match length for search expressions added after this call
+ * \param  finder          pcre2_finder object
+ * \param  maxlen          maximum number of bytes a match can span (0 for no limit, which is the default)
+ * \sa     pcre2_finder_add_expr()
+ * \sa     pcre2_finder_get_max_match_length()
+ *
+ * Data is held back while a match may still be in progress. With a declared maximum match length a partial match
+ * that grows beyond \p maxlen (plus one byte for assertions) is released, so output never lags more than that behind
+ * the input, even for expressions like "BEGIN.*END" that could otherwise match unbounded data.
+ * Matches longer than \p maxlen may be missed, depending on how the data is split into chunks.
+ */
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_max_match_length (struct pcre2_finder* finder, size_t maxlen);
+
+/*! \brief set PCRE2 match limits for search expressions added after this call
+ * \param  finder          pcre2_finder object
+ * \param  matchlimit      maximum number of internal matching steps per search (see pcre2_set_match_limit())
+ * \param  depthlimit      maximum backtracking depth per search (see pcre2_set_depth_limit())
+ * \param  heaplimit       maximum heap memory per search in kibibytes (see pcre2_set_heap_limit())
+ * \sa     pcre2_finder_set_limit_policy()
+ *
+ * A value of 0 keeps the default PCRE2 was built with. When a limit is hit pcre2_finder_process() returns the PCRE2
+ * error (like PCRE2_ERROR_MATCHLIMIT), unless the limit policy is PCRE2_FINDER_LIMIT_SKIP.
+ * JIT compiled expressions ignore the depth and heap limits, they are limited by the size of the JIT stack instead.
+ */
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_match_limits (struct pcre2_finder* finder, uint32_t matchlimit, uint32_t depthlimit, uint32_t heaplimit);
+
+/*! \brief set time limit for search expressions added after this call
+ * \param  finder          pcre2_finder object
+ * \param  timelimit       maximum time in nanoseconds each expression spends on the data of one call to pcre2_finder_process() (0 for no limit, which is the default)
+ * \sa     pcre2_finder_set_limit_policy()
+ *
+ * The expressions are compiled with PCRE2_AUTO_CALLOUT to check the time during each search as well (every 256
+ * callouts), which makes searching them slower. When the time is up the expression returns
+ * PCRE2_FINDER_ERROR_TIMELIMIT, unless the limit policy is PCRE2_FINDER_LIMIT_SKIP.
+ * Literal expressions searched with an Aho-Corasick automaton (see pcre2_finder_add_expr()) are searched in linear
+ * time and aren't limited.
+ */
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_time_limit (struct pcre2_finder* finder, unsigned long long timelimit);
+
+/*! \brief set what happens when a search expression added after this call hits a limit
+ * \param  finder          pcre2_finder object
+ * \param  policy          PCRE2_FINDER_LIMIT_FAIL (default) or PCRE2_FINDER_LIMIT_SKIP
+ * \return zero on success
+ * \sa     pcre2_finder_set_match_limits()
+ * \sa     pcre2_finder_set_time_limit()
+ *
+ * With PCRE2_FINDER_LIMIT_SKIP the rest of the data passed to pcre2_finder_process() (or the partial match carried
+ * from the previous data) is output as non-matching data by the expression that hit the limit, so matches in it are
+ * missed. The number of times this happened is counted in the statistics.
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_set_limit_policy (struct pcre2_finder* finder, int policy);
+
+/*! \brief get maximum match length of all search expressions
+ * \param  finder          pcre2_finder object
+ * \return maximum number of bytes a match can span, or 0 if unbounded
+ * \sa     pcre2_finder_set_max_match_length()
+ *
+ * For each expression the declared maximum match length is used, or else the length derived from the expression
+ * (lookahead assertions included), which is unbounded for repeats like * or + and for back references or recursion.
+ * Expressions with a derived bound never hold back more data than that, whether declared or not.
+ */
+DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_get_max_match_length (struct pcre2_finder* finder);
+
+/*! \brief get size of the largest DFA matching workspace of all search expressions
+ * \param  finder          pcre2_finder object
+ * \return number of ints in the largest workspace used by pcre2_dfa_match() (0 if no expression uses it)
+ * \sa     pcre2_finder_set_engine()
+ *
+ * The workspace of each expression starts with a size estimated from the compiled expression and is doubled
+ * whenever pcre2_dfa_match() runs out of space, after which the search is repeated. Growing stops at 4M ints,
+ * after which pcre2_finder_process() returns PCRE2_ERROR_DFA_WSSIZE. The size is kept for later searches,
+ * so the value returned is the high-water mark of the data searched so far.
+ */
+DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_get_dfa_workspace_size (struct pcre2_finder* finder);
+
+/*! \brief set number of worker threads used to search the expressions of streams opened after this call
+ * \param  finder          pcre2_finder object
+ * \param  threads         number of worker threads (0 or 1 to search on the calling thread, which is the default)
+ * \return zero on success, -1 if the library was built without thread support, for a stream created by pcre2_finder_create_stream()
+ *         or when matches are collected with pcre2_finder_set_match_batch()
+ * \sa     pcre2_finder_open()
+ * \sa     pcre2_finder_close()
+ *
+ * With more than one thread the chain of expressions is split into groups of consecutive expressions, each group
+ * searched on its own worker thread and fed through a ring buffer by the previous one, which blocks while the ring
+ * buffer is full. The output is the same as when searching on the calling thread.
+ * pcre2_finder_process() copies the data and returns, match functions and the output function are called on the
+ * worker threads, so they must not share state with each other or with the caller until pcre2_finder_close() has
+ * drained the data and joined the threads. pcre2_finder_process() returns errors from previously processed data.
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_set_threads (struct pcre2_finder* finder, unsigned int threads);
+
+/*! \brief collect matches in a batch instead of calling the match function of each expression
+ * \param  finder          pcre2_finder object
+ * \param  matches         array receiving the matches (must stay valid while searching)
+ * \param  maxmatches      number of elements in \p matches
+ * \param  batchfn         function to call with the collected matches (or NULL to call the match functions again)
+ * \param  callbackdata    custom data to be passed to \p batchfn
+ * \return zero on success, -1 if \p matches is missing or worker threads are used
+ * \sa     pcre2_finder_batch_fn
+ * \sa     pcre2_finder_open()
+ *
+ * Takes effect on the next call to pcre2_finder_open(). Matches of all expressions are added to \p matches and
+ * passed to \p batchfn once per call to pcre2_finder_process() or pcre2_finder_close(), or earlier when the
+ * array is full or when data they point to is about to be overwritten. The match data of the first expression
+ * points into the data passed to pcre2_finder_process() unless the match started in a previous call, later
+ * expressions search the output of the previous ones. As no match function is called, matches can't output
+ * replacement data. Each stream created by pcre2_finder_create_stream() needs its own batch.
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_set_match_batch (struct pcre2_finder* finder, struct pcre2_finder_match* matches, size_t maxmatches, pcre2_finder_batch_fn batchfn, void* callbackdata);
+
+/*! \brief statistics of one node in the chain of search expressions, see pcre2_finder_get_stats() */
+struct pcre2_finder_stats {
+  int matchid;                          /*!< match id of the (first) expression searched by this node */
+  size_t exprcount;                     /*!< number of expressions searched by this node (more than one when searched simultaneously) */
+  unsigned long long bytesin;           /*!< number of bytes passed to this node */
+  unsigned long long bytesout;          /*!< number of bytes passed on to the output function (the next node for all but the last) */
+  unsigned long long matches;           /*!< number of matches reported */
+  unsigned long long searches;          /*!< number of calls to pcre2_dfa_match(), pcre2_match() or the literal search automaton */
+  unsigned long long partialcarries;    /*!< number of times a partial match was held back for the next data */
+  size_t partialpeak;                   /*!< largest partial match held back in bytes */
+  unsigned long long searchtime;        /*!< time spent in the searches in nanoseconds */
+  unsigned long long limitskips;        /*!< number of times data was skipped after hitting a limit (see PCRE2_FINDER_LIMIT_SKIP) */
+};
+
+/*! \brief set if statistics are collected for streams opened after this call
+ * \param  finder          pcre2_finder object
+ * \param  enable          non-zero to collect statistics, zero to stop collecting them (default)
+ * \sa     pcre2_finder_get_stats()
+ *
+ * The counters are reset by pcre2_finder_open(). Collecting only adds a few counter updates and reads a
+ * monotonic clock around each search, so it can be left on.
+ */
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_stats (struct pcre2_finder* finder, int enable);
+
+/*! \brief get statistics of each node in the chain of search expressions
+ * \param  finder          pcre2_finder object
+ * \param  stats           array receiving the statistics of each node in chain order (can be NULL)
+ * \param  count           number of elements in stats
+ * \return number of nodes in the chain (statistics of nodes beyond count are not returned)
+ * \sa     pcre2_finder_set_stats()
+ *
+ * Each layered expression, or group of expressions searched simultaneously, is a node that searches the
+ * output of the previous node. When using worker threads only call this after pcre2_finder_close().
+ */
+DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_get_stats (struct pcre2_finder* finder, struct pcre2_finder_stats* stats, size_t count);
+
+/*! \brief check if the PCRE2 library supports JIT compilation
+ * \return non-zero if JIT is available
+ * \sa     pcre2_finder_set_engine()
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_jit_available ();
+
 /*! \brief function (of type pcre2_finder_output_fn) to write data to a FILE* stream
  * \param  callbackdata    output stream (of type FILE*)
  * \param  data            data to be written
@@ -181,31 +444,190 @@ DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_output_to_stream (void* callbackdata
  */
 DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_output_to_null (void* callbackdata, const char* data, size_t datalen);
 
+/*! \brief output sink collecting data fragments to be written with writev()
+ * \sa     pcre2_finder_writev_sink_create()
+ * \sa     pcre2_finder_output_to_writev()
+ */
+struct pcre2_finder_writev_sink;
+
+/*! \brief create output sink writing to a file descriptor with writev()
+ * \param  fd              file descriptor to write to
+ * \return output sink or NULL on error
+ * \sa     pcre2_finder_writev_sink_destroy()
+ * \sa     pcre2_finder_output_to_writev()
+ */
+DLL_EXPORT_PCRE2_FINDER struct pcre2_finder_writev_sink* pcre2_finder_writev_sink_create (int fd);
+
+/*! \brief write out pending data and destroy output sink
+ * \param  sink            output sink
+ * \return zero on success, -1 if writing failed
+ * \sa     pcre2_finder_writev_sink_create()
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_writev_sink_destroy (struct pcre2_finder_writev_sink* sink);
+
+/*! \brief write out pending data
+ * \param  sink            output sink
+ * \return zero on success, -1 if writing failed (now or before)
+ * \sa     pcre2_finder_output_to_writev()
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_writev_sink_flush (struct pcre2_finder_writev_sink* sink);
+
+/*! \brief function (of type pcre2_finder_output_fn) to collect data in an output sink without copying it
+ * \param  callbackdata    output sink (of type struct pcre2_finder_writev_sink*)
+ * \param  data            data to be written
+ * \param  datalen         length of data to be written
+ * \return number of bytes collected
+ * \sa     pcre2_finder_writev_sink_create()
+ * \sa     pcre2_finder_output_fn
+ *
+ * Only references to the data are kept, so pcre2_finder_writev_sink_flush() must be called before the data passed
+ * to pcre2_finder_process() or pcre2_finder_output() is reused, at the latest after pcre2_finder_process() or
+ * pcre2_finder_close() returns. Data from internal buffers is written out automatically when needed.
+ */
+DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_output_to_writev (void* callbackdata, const char* data, size_t datalen);
+
+/*! \brief finish compiling the search expressions added so far
+ * \param  finder          pcre2_finder object
+ * \return zero on success, non-zero if combined expressions failed to compile
+ * \sa     pcre2_finder_create_stream()
+ * \sa     pcre2_finder_open()
+ *
+ * Expressions searched simultaneously are combined and literal automata are built when the first stream is opened
+ * or created. Call this once before creating streams from multiple threads, after which the expressions are not
+ * changed anymore.
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_prepare (struct pcre2_finder* finder);
+
+/*! \brief create a stream searching the expressions of a pcre2_finder object without compiling them again
+ * \param  finder          pcre2_finder object holding the expressions
+ * \return new pcre2_finder object to be used with pcre2_finder_open(), pcre2_finder_process() and
+ *         pcre2_finder_close() and to be freed with pcre2_finder_cleanup() (or NULL on error)
+ * \sa     pcre2_finder_prepare()
+ * \sa     pcre2_finder_set_user_data()
+ *
+ * The stream shares the compiled expressions, match functions and their callback data with \p finder and only
+ * allocates the state of a data stream (partial matches, match data, DFA workspaces and a JIT stack), so many
+ * streams can be searched at the same time, each on any thread. \p finder must not be changed or cleaned up while
+ * streams created from it exist. Expressions can't be added to a stream and it can't use worker threads.
+ */
+DLL_EXPORT_PCRE2_FINDER struct pcre2_finder* pcre2_finder_create_stream (struct pcre2_finder* finder);
+
+/*! \brief set custom data for identifying a stream in match functions
+ * \param  finder          pcre2_finder object
+ * \param  userdata        custom data (streams created by pcre2_finder_create_stream() start with that of \p finder)
+ * \sa     pcre2_finder_get_user_data()
+ */
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_user_data (struct pcre2_finder* finder, void* userdata);
+
+/*! \brief get custom data set with pcre2_finder_set_user_data(), to be used inside pcre2_finder_match_fn
+ * \param  finder          pcre2_finder object as passed to pcre2_finder_match_fn
+ * \return custom data
+ * \sa     pcre2_finder_set_user_data()
+ */
+DLL_EXPORT_PCRE2_FINDER void* pcre2_finder_get_user_data (struct pcre2_finder* finder);
+
+/*! \brief get the offset of the match being reported, to be used inside pcre2_finder_match_fn
+ * \param  finder          pcre2_finder object as passed to pcre2_finder_match_fn
+ * \return offset of the first byte of the match from the start of the stream
+ * \sa     pcre2_finder_match_fn
+ *
+ * Offsets count all data passed to the expression since pcre2_finder_open() and stay correct for matches found in
+ * data carried over from previous calls. For the first expression, expressions searched simultaneously and
+ * independent search (see pcre2_finder_open_independent()) this is the offset in the input. Layered expressions
+ * after the first one search the output of the previous one, so their offsets are in that output.
+ */
+DLL_EXPORT_PCRE2_FINDER unsigned long long pcre2_finder_get_match_offset (struct pcre2_finder* finder);
+
+/*! \brief get the amount of data held back by all search expressions of a stream
+ * \param  finder          pcre2_finder object
+ * \return number of bytes of partial matches waiting for more data
+ * \sa     pcre2_finder_process()
+ *
+ * When this returns 0 after pcre2_finder_process(), all data passed so far has been searched completely and the
+ * search of the next data doesn't depend on it. Two streams of the same finder that are both in this state at the
+ * same position in the input (even if they started at different positions) find the same matches in the data that
+ * follows, as long as it is passed in the same blocks. Not meaningful with worker threads.
+ */
+DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_get_pending (struct pcre2_finder* finder);
+
+/*! \brief save the compiled search expressions to a cache file
+ * \param  finder          pcre2_finder object
+ * \param  filename        path of the cache file (replaced when complete)
+ * \param  key             value identifying the expressions and settings used to build \p finder (e.g. a hash)
+ * \return zero on success, -1 if expressions failed to compile or serialize, -2 on memory allocation error,
+ *         -3 if the file could not be written
+ * \sa     pcre2_finder_load()
+ *
+ * The file holds the expressions serialized with pcre2_serialize_encode() together with their flags, match ids,
+ * mode, engine and length limits, and can only be loaded with the same PCRE2 version on a similar system.
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_save (struct pcre2_finder* finder, const char* filename, unsigned long long key);
+
+/*! \brief load compiled search expressions from a cache file instead of adding them
+ * \param  finder          pcre2_finder object without expressions
+ * \param  filename        path of the cache file written by pcre2_finder_save()
+ * \param  key             value that must match the one passed to pcre2_finder_save()
+ * \param  matchfn         function to call for each match
+ * \param  callbackdata    user data to pass to matchfn
+ * \return zero on success, 1 if the cache was saved with a different key or PCRE2 version, -1 if \p finder already
+ *         has expressions, -2 on memory allocation error, -3 if the file could not be read, -4 if it is not a valid
+ *         cache file
+ * \sa     pcre2_finder_save()
+ * \sa     pcre2_finder_add_expr()
+ *
+ * The file is memory mapped where possible and the expressions are decoded with pcre2_serialize_decode(), so no
+ * expression is compiled again apart from JIT compilation when that engine was selected. All expressions report
+ * matches to \p matchfn with the match id they were added with. As PCRE2 doesn't validate serialized data, only
+ * load cache files from a trusted location. On errors other than 1 and -1 the object should be cleaned up.
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_load (struct pcre2_finder* finder, const char* filename, unsigned long long key, pcre2_finder_match_fn matchfn, void* callbackdata);
+
 /*! \brief open data stream for searching
  * \param  finder          pcre2_finder object
  * \param  outputfn        function to call for processing output
  * \param  callbackdata    custom data to be passed to \p outputfn
- * \return zero on success
+ * \return zero on success, -3 if combined expressions failed to compile, -4 if worker threads failed to start
  * \sa     pcre2_finder_process()
  * \sa     pcre2_finder_close()
  * \sa     pcre2_finder_output_fn
+ * \sa     pcre2_finder_set_threads()
  */
 DLL_EXPORT_PCRE2_FINDER int pcre2_finder_open (struct pcre2_finder* finder, pcre2_finder_output_fn outputfn, void* callbackdata);
 
+/*! \brief open data stream for searching with each expression independently, without producing output
+ * \param  finder          pcre2_finder object
+ * \return zero on success, -3 if combined expressions failed to compile, -4 if worker threads failed to start
+ * \sa     pcre2_finder_open()
+ * \sa     pcre2_finder_process()
+ * \sa     pcre2_finder_close()
+ *
+ * Instead of searching the output of the previous expression, each layered expression (or group of expressions
+ * searched simultaneously) searches the data passed to pcre2_finder_process() itself, so matches of one expression
+ * don't hide matches of another. Non-matching data isn't passed on and pcre2_finder_output() does nothing, so this
+ * is meant for counting or indexing matches. With worker threads each group of expressions gets its own copy of the
+ * data and the groups are searched in parallel.
+ */
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_open_independent (struct pcre2_finder* finder);
+
 /*! \brief process chunk of data for searching
  * \param  finder          pcre2_finder object
  * \param  data            data to be processed
  * \param  datalen         length of data to be processed
- * \return zero or higher on success
+ * \return zero on success, PCRE2_FINDER_ABORTED if matching was aborted by a match function, negative on error
  * \sa     pcre2_finder_open()
  * \sa     pcre2_finder_close()
  * \sa     pcre2_finder_add_expr()
+ *
+ * After matching was aborted further data is ignored (and pcre2_finder_close() reports no more matches) until the
+ * stream is opened again, so the caller can stop reading input. When using worker threads other groups of
+ * expressions stop after the data they are searching, so they may still report some matches.
  */
 DLL_EXPORT_PCRE2_FINDER int pcre2_finder_process (struct pcre2_finder* finder, const char* data, size_t datalen);
 
 /*! \brief close data stream
  * \param  finder          pcre2_finder object
- * \return zero on success
+ * \return zero on success, PCRE2_FINDER_ABORTED if matching was aborted by a match function (when using worker
+ *         threads the first error returned while processing the data)
  * \sa     pcre2_finder_open()
  * \sa     pcre2_finder_process()
  */
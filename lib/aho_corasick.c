@@ -0,0 +1,247 @@
+#include "aho_corasick.h"
+#include <stdint.h>
+#include <string.h>
+
+#define AHO_CORASICK_ROOT 0
+
+struct aho_corasick_struct {
+  int caseless;
+  unsigned short classmap[256];
+  size_t classcount;
+  int32_t* transitions;
+  int32_t* fail;
+  int32_t* outlink;
+  int32_t* terminal;
+  uint32_t* depth;
+  size_t statecount;
+  size_t statealloc;
+  size_t* lengths;
+  size_t count;
+  int built;
+  char** literals;
+};
+
+struct aho_corasick_struct* aho_corasick_initialize (int caseless)
+{
+  struct aho_corasick_struct* result;
+  if ((result = (struct aho_corasick_struct*)malloc(sizeof(struct aho_corasick_struct))) != NULL) {
+    result->caseless = caseless;
+    memset(result->classmap, 0, sizeof(result->classmap));
+    result->classcount = 1;
+    result->transitions = NULL;
+    result->fail = NULL;
+    result->outlink = NULL;
+    result->terminal = NULL;
+    result->depth = NULL;
+    result->statecount = 0;
+    result->statealloc = 0;
+    result->lengths = NULL;
+    result->count = 0;
+    result->built = 0;
+    result->literals = NULL;
+  }
+  return result;
+}
+
+static void free_automaton (struct aho_corasick_struct* ac)
+{
+  free(ac->transitions);
+  free(ac->fail);
+  free(ac->outlink);
+  free(ac->terminal);
+  free(ac->depth);
+  ac->transitions = NULL;
+  ac->fail = NULL;
+  ac->outlink = NULL;
+  ac->terminal = NULL;
+  ac->depth = NULL;
+  ac->statecount = 0;
+  ac->statealloc = 0;
+  ac->built = 0;
+}
+
+void aho_corasick_cleanup (struct aho_corasick_struct* ac)
+{
+  size_t i;
+  if (ac) {
+    free_automaton(ac);
+    for (i = 0; i < ac->count; i++)
+      free(ac->literals[i]);
+    free(ac->literals);
+    free(ac->lengths);
+    free(ac);
+  }
+}
+
+static unsigned char fold (const struct aho_corasick_struct* ac, unsigned char c)
+{
+  if (ac->caseless && c >= 'A' && c <= 'Z')
+    return c - 'A' + 'a';
+  return c;
+}
+
+int aho_corasick_add (struct aho_corasick_struct* ac, const char* literal, size_t literallen)
+{
+  char** literals;
+  size_t* lengths;
+  if (literallen == 0)
+    return -1;
+  if ((literals = (char**)realloc(ac->literals, (ac->count + 1) * sizeof(char*))) == NULL)
+    return -2;
+  ac->literals = literals;
+  if ((lengths = (size_t*)realloc(ac->lengths, (ac->count + 1) * sizeof(size_t))) == NULL)
+    return -2;
+  ac->lengths = lengths;
+  if ((ac->literals[ac->count] = (char*)malloc(literallen)) == NULL)
+    return -2;
+  memcpy(ac->literals[ac->count], literal, literallen);
+  ac->lengths[ac->count] = literallen;
+  ac->count++;
+  //automaton needs to be rebuilt
+  ac->built = 0;
+  return 0;
+}
+
+static int32_t new_state (struct aho_corasick_struct* ac, uint32_t depth)
+{
+  size_t i;
+  if (ac->statecount == ac->statealloc) {
+    size_t newalloc = (ac->statealloc ? ac->statealloc * 2 : 64);
+    int32_t* transitions;
+    int32_t* terminal;
+    uint32_t* depths;
+    if ((transitions = (int32_t*)realloc(ac->transitions, newalloc * ac->classcount * sizeof(int32_t))) == NULL)
+      return -1;
+    ac->transitions = transitions;
+    if ((terminal = (int32_t*)realloc(ac->terminal, newalloc * sizeof(int32_t))) == NULL)
+      return -1;
+    ac->terminal = terminal;
+    if ((depths = (uint32_t*)realloc(ac->depth, newalloc * sizeof(uint32_t))) == NULL)
+      return -1;
+    ac->depth = depths;
+    ac->statealloc = newalloc;
+  }
+  for (i = 0; i < ac->classcount; i++)
+    ac->transitions[ac->statecount * ac->classcount + i] = -1;
+  ac->terminal[ac->statecount] = -1;
+  ac->depth[ac->statecount] = depth;
+  return (int32_t)ac->statecount++;
+}
+
+int aho_corasick_build (struct aho_corasick_struct* ac)
+{
+  size_t i;
+  size_t j;
+  size_t c;
+  int32_t state;
+  int32_t* queue;
+  size_t queuehead;
+  size_t queuetail;
+  if (ac->built)
+    return 0;
+  free_automaton(ac);
+  //map the bytes used in the literals to character classes, all other bytes share class 0
+  memset(ac->classmap, 0, sizeof(ac->classmap));
+  ac->classcount = 1;
+  for (i = 0; i < ac->count; i++) {
+    for (j = 0; j < ac->lengths[i]; j++) {
+      c = fold(ac, (unsigned char)ac->literals[i][j]);
+      if (!ac->classmap[c])
+        ac->classmap[c] = (unsigned short)ac->classcount++;
+    }
+  }
+  if (ac->caseless)
+    for (c = 'A'; c <= 'Z'; c++)
+      ac->classmap[c] = ac->classmap[c - 'A' + 'a'];
+  //build trie
+  if (new_state(ac, 0) != AHO_CORASICK_ROOT)
+    return -2;
+  for (i = 0; i < ac->count; i++) {
+    state = AHO_CORASICK_ROOT;
+    for (j = 0; j < ac->lengths[i]; j++) {
+      int32_t next;
+      c = ac->classmap[(unsigned char)ac->literals[i][j]];
+      if ((next = ac->transitions[state * ac->classcount + c]) < 0) {
+        if ((next = new_state(ac, (uint32_t)j + 1)) < 0)
+          return -2;
+        ac->transitions[state * ac->classcount + c] = next;
+      }
+      state = next;
+    }
+    //the first literal added wins when the same literal is added again
+    if (ac->terminal[state] < 0)
+      ac->terminal[state] = (int32_t)i;
+  }
+  //compute failure and output links in breadth first order and complete the transition table
+  if ((ac->fail = (int32_t*)malloc(ac->statecount * sizeof(int32_t))) == NULL || (ac->outlink = (int32_t*)malloc(ac->statecount * sizeof(int32_t))) == NULL || (queue = (int32_t*)malloc(ac->statecount * sizeof(int32_t))) == NULL)
+    return -2;
+  ac->fail[AHO_CORASICK_ROOT] = AHO_CORASICK_ROOT;
+  ac->outlink[AHO_CORASICK_ROOT] = AHO_CORASICK_ROOT;
+  queuehead = 0;
+  queuetail = 0;
+  queue[queuetail++] = AHO_CORASICK_ROOT;
+  while (queuehead < queuetail) {
+    state = queue[queuehead++];
+    for (c = 0; c < ac->classcount; c++) {
+      int32_t* transition = &ac->transitions[state * ac->classcount + c];
+      if (*transition >= 0) {
+        int32_t child = *transition;
+        int32_t fail = (state == AHO_CORASICK_ROOT ? AHO_CORASICK_ROOT : ac->transitions[ac->fail[state] * ac->classcount + c]);
+        ac->fail[child] = fail;
+        ac->outlink[child] = (ac->terminal[fail] >= 0 ? fail : ac->outlink[fail]);
+        queue[queuetail++] = child;
+      } else {
+        *transition = (state == AHO_CORASICK_ROOT ? AHO_CORASICK_ROOT : ac->transitions[ac->fail[state] * ac->classcount + c]);
+      }
+    }
+  }
+  free(queue);
+  ac->built = 1;
+  return 0;
+}
+
+size_t aho_corasick_get_count (const struct aho_corasick_struct* ac)
+{
+  return ac->count;
+}
+
+int aho_corasick_search (const struct aho_corasick_struct* ac, const char* data, size_t datalen, size_t pos, int final, size_t* matchstart, size_t* matchend, size_t* index)
+{
+  int32_t state = AHO_CORASICK_ROOT;
+  int32_t out;
+  size_t start;
+  int found = 0;
+  size_t beststart = 0;
+  size_t bestend = 0;
+  size_t bestindex = 0;
+  while (pos < datalen) {
+    state = ac->transitions[state * ac->classcount + ac->classmap[(unsigned char)data[pos++]]];
+    //check all literals ending here
+    for (out = (ac->terminal[state] >= 0 ? state : ac->outlink[state]); out != AHO_CORASICK_ROOT; out = ac->outlink[out]) {
+      start = pos - ac->lengths[ac->terminal[out]];
+      if (!found || start < beststart || (start == beststart && (size_t)ac->terminal[out] < bestindex)) {
+        found = 1;
+        beststart = start;
+        bestend = pos;
+        bestindex = ac->terminal[out];
+      }
+    }
+    //done when no literal in progress can start at or before the best match
+    if (found && pos - ac->depth[state] > beststart)
+      break;
+  }
+  if (found && (final || pos - ac->depth[state] > beststart)) {
+    *matchstart = beststart;
+    *matchend = bestend;
+    *index = bestindex;
+    return AHO_CORASICK_MATCH;
+  }
+  if (!final && (found || ac->depth[state] > 0)) {
+    *matchstart = pos - ac->depth[state];
+    if (found && beststart < *matchstart)
+      *matchstart = beststart;
+    *matchend = datalen;
+    return AHO_CORASICK_PARTIAL;
+  }
+  return AHO_CORASICK_NOMATCH;
+}
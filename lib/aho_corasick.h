@@ -0,0 +1,45 @@
+#ifndef INCLUDED_AHO_CORASICK_H
+#define INCLUDED_AHO_CORASICK_H
+
+#include <stdlib.h>
+
+/* C library for searching many literal strings in a single pass using an Aho-Corasick automaton */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//search results
+#define AHO_CORASICK_MATCH 1
+#define AHO_CORASICK_NOMATCH 0
+#define AHO_CORASICK_PARTIAL -1
+
+//data structure
+struct aho_corasick_struct;
+
+//initialize (caseless matching folds ASCII letters)
+struct aho_corasick_struct* aho_corasick_initialize (int caseless);
+
+//clean up
+void aho_corasick_cleanup (struct aho_corasick_struct* ac);
+
+//add literal string (index is the position in order of adding, returns non-zero on error)
+int aho_corasick_add (struct aho_corasick_struct* ac, const char* literal, size_t literallen);
+
+//build automaton after all literals were added (returns non-zero on error)
+int aho_corasick_build (struct aho_corasick_struct* ac);
+
+//get number of literals
+size_t aho_corasick_get_count (const struct aho_corasick_struct* ac);
+
+//find leftmost match at or after pos, when several literals start there the first added wins
+//returns AHO_CORASICK_MATCH with match position and literal index,
+//AHO_CORASICK_PARTIAL with position from where more data is needed (unless final is set),
+//or AHO_CORASICK_NOMATCH
+int aho_corasick_search (const struct aho_corasick_struct* ac, const char* data, size_t datalen, size_t pos, int final, size_t* matchstart, size_t* matchend, size_t* index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_AHO_CORASICK_H
@@ -0,0 +1,116 @@
+#include "pcre2_finder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+#endif
+
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define WRITEV_MAX_FRAGMENTS IOV_MAX
+#else
+#define WRITEV_MAX_FRAGMENTS 1024
+#endif
+
+#ifdef _WIN32
+//Windows has no writev(), fragments are written one by one
+struct iovec {
+  void* iov_base;
+  size_t iov_len;
+};
+#endif
+
+struct pcre2_finder_writev_sink {
+  int fd;
+  int error;
+  int count;
+  struct iovec fragments[WRITEV_MAX_FRAGMENTS];
+};
+
+DLL_EXPORT_PCRE2_FINDER struct pcre2_finder_writev_sink* pcre2_finder_writev_sink_create (int fd)
+{
+  struct pcre2_finder_writev_sink* sink;
+  if ((sink = (struct pcre2_finder_writev_sink*)malloc(sizeof(struct pcre2_finder_writev_sink))) != NULL) {
+    sink->fd = fd;
+    sink->error = 0;
+    sink->count = 0;
+  }
+  return sink;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_writev_sink_destroy (struct pcre2_finder_writev_sink* sink)
+{
+  int status;
+  if (!sink)
+    return 0;
+  status = pcre2_finder_writev_sink_flush(sink);
+  free(sink);
+  return status;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_writev_sink_flush (struct pcre2_finder_writev_sink* sink)
+{
+  struct iovec* fragment = sink->fragments;
+  int count = sink->count;
+#ifdef _WIN32
+  int written;
+#else
+  ssize_t written;
+#endif
+  sink->count = 0;
+  while (count > 0 && !sink->error) {
+#ifdef _WIN32
+    written = _write(sink->fd, fragment->iov_base, (unsigned int)fragment->iov_len);
+#else
+    written = writev(sink->fd, fragment, count);
+#endif
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      sink->error = 1;
+      break;
+    }
+    //skip fragments that were written completely and adjust the one that was written partially
+    while (count > 0 && (size_t)written >= fragment->iov_len) {
+      written -= fragment->iov_len;
+      fragment++;
+      count--;
+    }
+    if (count > 0) {
+      fragment->iov_base = (char*)fragment->iov_base + written;
+      fragment->iov_len -= written;
+    }
+  }
+  return (sink->error ? -1 : 0);
+}
+
+DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_output_to_writev (void* callbackdata, const char* data, size_t datalen)
+{
+  struct pcre2_finder_writev_sink* sink = (struct pcre2_finder_writev_sink*)callbackdata;
+  struct iovec* last;
+  //write out referenced data when the finder is about to overwrite it
+  if (!data) {
+    pcre2_finder_writev_sink_flush(sink);
+    return 0;
+  }
+  if (datalen == 0)
+    return 0;
+  //extend the last fragment if the data follows it directly
+  if (sink->count > 0) {
+    last = &sink->fragments[sink->count - 1];
+    if ((const char*)last->iov_base + last->iov_len == data) {
+      last->iov_len += datalen;
+      return datalen;
+    }
+  }
+  if (sink->count >= WRITEV_MAX_FRAGMENTS)
+    pcre2_finder_writev_sink_flush(sink);
+  sink->fragments[sink->count].iov_base = (void*)data;
+  sink->fragments[sink->count].iov_len = datalen;
+  sink->count++;
+  return datalen;
+}
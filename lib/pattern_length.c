@@ -0,0 +1,387 @@
+#include "pattern_length.h"
+#include "pcre2_finder.h"
+#include <string.h>
+
+struct pattern_parser {
+  const char* p;
+  const char* end;
+  int extended;
+  int utf;
+  int giveup;
+};
+
+static size_t parse_alternation (struct pattern_parser* parser);
+
+size_t pattern_length_add (size_t a, size_t b)
+{
+  if (a == PATTERN_LENGTH_UNBOUNDED || b == PATTERN_LENGTH_UNBOUNDED || a + b < a)
+    return PATTERN_LENGTH_UNBOUNDED;
+  return a + b;
+}
+
+static size_t multiply_length (size_t a, size_t n)
+{
+  if (a == 0 || n == 0)
+    return 0;
+  if (a == PATTERN_LENGTH_UNBOUNDED || n == PATTERN_LENGTH_UNBOUNDED || a > PATTERN_LENGTH_UNBOUNDED / n)
+    return PATTERN_LENGTH_UNBOUNDED;
+  return a * n;
+}
+
+static size_t char_length (struct pattern_parser* parser)
+{
+  //in UTF mode a character (or its other case) takes up to 4 bytes
+  return (parser->utf ? 4 : 1);
+}
+
+static int is_digit (char c)
+{
+  return (c >= '0' && c <= '9');
+}
+
+static int is_alpha (char c)
+{
+  return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_');
+}
+
+static void skip_to (struct pattern_parser* parser, char c)
+{
+  while (parser->p < parser->end && *parser->p != c)
+    parser->p++;
+  if (parser->p < parser->end)
+    parser->p++;
+}
+
+static void skip_digits (struct pattern_parser* parser, int maxdigits, int hex)
+{
+  char c;
+  while (maxdigits-- > 0 && parser->p < parser->end) {
+    c = *parser->p;
+    if (!(c >= '0' && c <= '7') && !(hex && ((c >= '8' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))))
+      break;
+    parser->p++;
+  }
+}
+
+static void skip_extended (struct pattern_parser* parser)
+{
+  if (!parser->extended)
+    return;
+  while (parser->p < parser->end) {
+    if (*parser->p == ' ' || (*parser->p >= '\t' && *parser->p <= '\r'))
+      parser->p++;
+    else if (*parser->p == '#')
+      skip_to(parser, '\n');
+    else
+      break;
+  }
+}
+
+static size_t parse_escape (struct pattern_parser* parser)
+{
+  size_t len;
+  char c;
+  if (parser->p >= parser->end)
+    return 0;
+  c = *parser->p++;
+  switch (c) {
+    case 'b' :
+    case 'B' :
+    case 'A' :
+    case 'Z' :
+    case 'z' :
+    case 'G' :
+    case 'K' :
+    case 'E' :
+      return 0;
+    case 'Q' :
+      //quoted literal text up to \E
+      len = 0;
+      while (parser->p < parser->end && !(parser->p[0] == '\\' && parser->p + 1 < parser->end && parser->p[1] == 'E')) {
+        if (((unsigned char)*parser->p & 0xC0) != 0x80)
+          len += char_length(parser);
+        parser->p++;
+      }
+      if (parser->p < parser->end)
+        parser->p += 2;
+      return len;
+    case 'g' :
+    case 'k' :
+    case 'X' :
+      //back references, subroutine calls and extended grapheme clusters
+      return PATTERN_LENGTH_UNBOUNDED;
+    case 'R' :
+      return (parser->utf ? 4 : 2);
+    case 'x' :
+    case 'o' :
+    case 'p' :
+    case 'P' :
+    case 'N' :
+      if (parser->p < parser->end && *parser->p == '{')
+        skip_to(parser, '}');
+      else if (c == 'x')
+        skip_digits(parser, 2, 1);
+      else if (c == 'p' || c == 'P')
+        parser->p++;
+      return char_length(parser);
+    case 'c' :
+      parser->p++;
+      return char_length(parser);
+    case '0' :
+      skip_digits(parser, 2, 0);
+      return char_length(parser);
+    default :
+      //\1 to \9 are back references
+      if (c >= '1' && c <= '9')
+        return PATTERN_LENGTH_UNBOUNDED;
+      return char_length(parser);
+  }
+}
+
+static size_t parse_class (struct pattern_parser* parser)
+{
+  if (parser->p < parser->end && *parser->p == '^')
+    parser->p++;
+  if (parser->p < parser->end && *parser->p == ']')
+    parser->p++;
+  while (parser->p < parser->end && *parser->p != ']') {
+    if (*parser->p == '\\') {
+      parser->p++;
+      if (parser->p < parser->end && *parser->p == 'Q') {
+        while (parser->p < parser->end && !(parser->p[0] == '\\' && parser->p + 1 < parser->end && parser->p[1] == 'E'))
+          parser->p++;
+      }
+      if (parser->p < parser->end)
+        parser->p++;
+    } else if (*parser->p == '[' && parser->p + 1 < parser->end && (parser->p[1] == ':' || parser->p[1] == '.' || parser->p[1] == '=')) {
+      //POSIX class like [:alpha:]
+      parser->p += 2;
+      while (parser->p + 1 < parser->end && parser->p[1] != ']')
+        parser->p++;
+      parser->p += 2;
+    } else {
+      parser->p++;
+    }
+  }
+  if (parser->p < parser->end)
+    parser->p++;
+  return char_length(parser);
+}
+
+static size_t parse_quantifier (struct pattern_parser* parser)
+{
+  size_t result = 1;
+  skip_extended(parser);
+  if (parser->p >= parser->end)
+    return 1;
+  if (*parser->p == '*' || *parser->p == '+') {
+    parser->p++;
+    result = PATTERN_LENGTH_UNBOUNDED;
+  } else if (*parser->p == '?') {
+    parser->p++;
+  } else if (*parser->p == '{') {
+    //only {n}, {n,} and {n,m} are quantifiers, otherwise { is a literal
+    const char* q = parser->p + 1;
+    size_t minimum = 0;
+    size_t maximum = 0;
+    int hasmin = 0;
+    int hasmax = 0;
+    int comma = 0;
+    while (q < parser->end && *q == ' ')
+      q++;
+    while (q < parser->end && is_digit(*q)) {
+      minimum = minimum * 10 + (*q++ - '0');
+      hasmin = 1;
+    }
+    while (q < parser->end && *q == ' ')
+      q++;
+    if (q < parser->end && *q == ',') {
+      comma = 1;
+      q++;
+      while (q < parser->end && *q == ' ')
+        q++;
+      while (q < parser->end && is_digit(*q)) {
+        maximum = maximum * 10 + (*q++ - '0');
+        hasmax = 1;
+      }
+      while (q < parser->end && *q == ' ')
+        q++;
+    }
+    if (q >= parser->end || *q != '}' || !hasmin)
+      return 1;
+    parser->p = q + 1;
+    if (!comma)
+      result = minimum;
+    else if (!hasmax)
+      result = PATTERN_LENGTH_UNBOUNDED;
+    else
+      result = maximum;
+  } else {
+    return 1;
+  }
+  //skip lazy or possessive suffix
+  if (parser->p < parser->end && (*parser->p == '?' || *parser->p == '+'))
+    parser->p++;
+  return result;
+}
+
+static size_t parse_group_end (struct pattern_parser* parser, size_t len)
+{
+  if (parser->p < parser->end && *parser->p == ')')
+    parser->p++;
+  return len;
+}
+
+static size_t parse_group (struct pattern_parser* parser)
+{
+  const char* name;
+  size_t namelen;
+  size_t len;
+  //verbs and alphabetic assertions like (*MARK:x) or (*pla:...)
+  if (parser->p < parser->end && *parser->p == '*') {
+    name = ++parser->p;
+    while (parser->p < parser->end && is_alpha(*parser->p))
+      parser->p++;
+    namelen = parser->p - name;
+    if (parser->p < parser->end && *parser->p == ':' && namelen > 0 && name[0] >= 'a' && name[0] <= 'z') {
+      parser->p++;
+      len = parse_alternation(parser);
+      if ((namelen == 3 && (memcmp(name, "plb", 3) == 0 || memcmp(name, "nlb", 3) == 0)) || (namelen == 5 && memcmp(name, "naplb", 5) == 0) || (namelen > 10 && memcmp(name + namelen - 10, "lookbehind", 10) == 0))
+        len = 0;
+      return parse_group_end(parser, len);
+    }
+    skip_to(parser, ')');
+    return 0;
+  }
+  if (parser->p >= parser->end || *parser->p != '?')
+    return parse_group_end(parser, parse_alternation(parser));
+  parser->p++;
+  if (parser->p >= parser->end)
+    return 0;
+  switch (*parser->p) {
+    case '#' :
+    case 'C' :
+      //comment or callout
+      skip_to(parser, ')');
+      return 0;
+    case ':' :
+    case '|' :
+    case '>' :
+    case '=' :
+    case '!' :
+    case '*' :
+      //lookahead assertions are counted as they inspect data after the match
+      parser->p++;
+      return parse_group_end(parser, parse_alternation(parser));
+    case '<' :
+      if (parser->p + 1 < parser->end && (parser->p[1] == '=' || parser->p[1] == '!' || parser->p[1] == '*')) {
+        //lookbehind assertions inspect data before the match
+        parser->p += 2;
+        parse_alternation(parser);
+        return parse_group_end(parser, 0);
+      }
+      skip_to(parser, '>');
+      return parse_group_end(parser, parse_alternation(parser));
+    case '\'' :
+      parser->p++;
+      skip_to(parser, '\'');
+      return parse_group_end(parser, parse_alternation(parser));
+    case 'P' :
+      if (parser->p + 1 < parser->end && parser->p[1] == '<') {
+        skip_to(parser, '>');
+        return parse_group_end(parser, parse_alternation(parser));
+      }
+      //named back reference or subroutine call
+      return PATTERN_LENGTH_UNBOUNDED;
+    case 'R' :
+    case '&' :
+    case '+' :
+      //recursion or subroutine call
+      return PATTERN_LENGTH_UNBOUNDED;
+    case '(' :
+      //conditional group, skip the condition (which may be an assertion)
+      parser->p++;
+      if (parser->p < parser->end && (*parser->p == '?' || *parser->p == '*'))
+        parse_group(parser);
+      else
+        skip_to(parser, ')');
+      return parse_group_end(parser, parse_alternation(parser));
+    default :
+      if (is_digit(*parser->p) || (*parser->p == '-' && parser->p + 1 < parser->end && is_digit(parser->p[1])))
+        return PATTERN_LENGTH_UNBOUNDED;
+      //option setting, give up if extended mode may change as white space would be interpreted differently
+      while (parser->p < parser->end && *parser->p != ')' && *parser->p != ':') {
+        if (*parser->p == 'x')
+          parser->giveup = 1;
+        parser->p++;
+      }
+      if (parser->p < parser->end && *parser->p == ':') {
+        parser->p++;
+        return parse_group_end(parser, parse_alternation(parser));
+      }
+      return parse_group_end(parser, 0);
+  }
+}
+
+static size_t parse_atom (struct pattern_parser* parser)
+{
+  char c = *parser->p++;
+  switch (c) {
+    case '\\' :
+      return parse_escape(parser);
+    case '[' :
+      return parse_class(parser);
+    case '(' :
+      return parse_group(parser);
+    case '^' :
+    case '$' :
+      return 0;
+    default :
+      //count UTF-8 continuation bytes as part of the character
+      if (parser->utf && ((unsigned char)c & 0xC0) == 0x80)
+        return 0;
+      return char_length(parser);
+  }
+}
+
+static size_t parse_alternation (struct pattern_parser* parser)
+{
+  size_t result = 0;
+  size_t current = 0;
+  size_t atom;
+  for (;;) {
+    skip_extended(parser);
+    if (parser->p >= parser->end || *parser->p == ')')
+      break;
+    if (*parser->p == '|') {
+      parser->p++;
+      if (current > result)
+        result = current;
+      current = 0;
+      continue;
+    }
+    atom = parse_atom(parser);
+    current = pattern_length_add(current, multiply_length(atom, parse_quantifier(parser)));
+  }
+  return (current > result ? current : result);
+}
+
+size_t pattern_max_length (const char* pattern, unsigned int flags)
+{
+  struct pattern_parser parser;
+  size_t result;
+  parser.p = pattern;
+  parser.end = pattern + strlen(pattern);
+  parser.extended = (flags & (PCRE2_EXTENDED | PCRE2_EXTENDED_MORE) ? 1 : 0);
+  parser.utf = (flags & PCRE2_UTF ? 1 : 0);
+  parser.giveup = 0;
+  if (flags & PCRE2_LITERAL)
+    return multiply_length(parser.end - parser.p, char_length(&parser));
+  //in-pattern options like (*UTF) are not tracked
+  if (strstr(pattern, "(*UTF"))
+    parser.utf = 1;
+  result = parse_alternation(&parser);
+  if (parser.giveup || parser.p < parser.end)
+    return PATTERN_LENGTH_UNBOUNDED;
+  return result;
+}
@@ -0,0 +1,25 @@
+#ifndef INCLUDED_PATTERN_LENGTH_H
+#define INCLUDED_PATTERN_LENGTH_H
+
+#include <stdlib.h>
+
+/* C library for determining the maximum length of data a regular expression can match */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//value returned for patterns that can match data of any length
+#define PATTERN_LENGTH_UNBOUNDED ((size_t)-1)
+
+//get maximum number of bytes inspected when matching a (valid) PCRE2 pattern compiled with flags (PCRE2_*)
+size_t pattern_max_length (const char* pattern, unsigned int flags);
+
+//add lengths (saturating at PATTERN_LENGTH_UNBOUNDED)
+size_t pattern_length_add (size_t a, size_t b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_PATTERN_LENGTH_H
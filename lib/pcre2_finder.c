@@ -1,9 +1,28 @@
 #include "pcre2_finder.h"
+#include "prefilter.h"
+#include "aho_corasick.h"
+#include "pattern_length.h"
+#include "pipeline.h"
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
 
 #define PCRE2_OPTIONS PCRE2_PARTIAL_HARD | PCRE2_DFA_SHORTEST
 #define PCRE2_DFA_WORKSPACE_SIZE 128
+#define PCRE2_DFA_WORKSPACE_MAX 4 * 1024 * 1024
+#define PCRE2_MATCH_OPTIONS PCRE2_PARTIAL_HARD | PCRE2_NOTEMPTY
+#define PCRE2_JIT_STACK_START 32 * 1024
+#define PCRE2_JIT_STACK_MAX 1024 * 1024
+#define PCRE2_FINDER_ENGINE_NOJIT 2
+#define PARTIALMATCH_MIN_ALLOC 64
 
 DLL_EXPORT_PCRE2_FINDER void pcre2_finder_get_version (int* pmajor, int* pminor, int* pmicro)
 {
@@ -20,6 +39,30 @@ DLL_EXPORT_PCRE2_FINDER const char* pcre2_finder_get_version_string ()
   return PCRE2_FINDER_VERSION_STRING;
 }
 
+struct pcre2_finder_expr {
+  char* expr;
+  pcre2_finder_match_fn matchfn;
+  void* matchcallbackdata;
+  int matchid;
+};
+
+struct pcre2_finder_batch {
+  struct pcre2_finder* finder;
+  struct pcre2_finder_match* matches;
+  size_t maxmatches;
+  size_t count;
+  pcre2_finder_batch_fn batchfn;
+  void* callbackdata;
+};
+
+struct pcre2_finder_stage {
+  struct pcre2_finder* first;
+  struct pcre2_finder* last;
+  struct pipeline_struct* pipeline;
+  size_t index;
+  int aborted;
+};
+
 struct pcre2_finder {
   pcre2_finder_match_fn matchfn;
   void* matchcallbackdata;
@@ -28,11 +71,61 @@ struct pcre2_finder {
   void* outputcallbackdata;
   char* partialmatch;
   size_t partialmatchlen;
+  size_t partialmatchalloc;
+  size_t partialmatchsearched;
+  unsigned long long partialmatchpos;
+  unsigned long long inputpos;
+  unsigned long long matchpos;
+  size_t maxpartialmatch;
+  size_t newmaxpartialmatch;
+  size_t maxmatchlen;
+  size_t newmaxmatchlen;
+  size_t derivedmaxlen;
+  uint32_t matchlimit;
+  uint32_t newmatchlimit;
+  uint32_t depthlimit;
+  uint32_t newdepthlimit;
+  uint32_t heaplimit;
+  uint32_t newheaplimit;
+  unsigned long long timelimit;
+  unsigned long long newtimelimit;
+  unsigned long long deadline;
+  unsigned long timesteps;
+  int limitpolicy;
+  int newlimitpolicy;
   pcre2_code* re;
   pcre2_match_data* match_data;
   pcre2_match_context* match_context;
   int* dfaworkspace;
   size_t dfaworkspacesize;
+  int engine;
+  int newengine;
+  pcre2_jit_stack* jit_stack;
+  char* matchbuffer;
+  size_t matchbufferlen;
+  int bufferoutput;
+  int requestedengine;
+  int mode;
+  int newmode;
+  unsigned int flags;
+  struct pcre2_finder_expr* exprs;
+  size_t exprcount;
+  int useprefilter;
+  struct prefilter_struct prefilter;
+  struct aho_corasick_struct* literals;
+  size_t matchindex;
+  int collectstats;
+  struct pcre2_finder_stats stats;
+  void* userdata;
+  int shared;
+  struct pcre2_finder_batch batchdata;
+  struct pcre2_finder_batch* batch;
+  int abortdata;
+  int* aborted;
+  int independent;
+  unsigned int threads;
+  struct pipeline_struct* pipeline;
+  struct pcre2_finder_stage* stages;
   struct pcre2_finder* next;
   struct pcre2_finder* last;
 };
@@ -40,9 +133,6 @@ struct pcre2_finder {
 DLL_EXPORT_PCRE2_FINDER struct pcre2_finder* pcre2_finder_initialize ()
 {
   struct pcre2_finder* result;
-  int* dfaworkspace;
-  if ((dfaworkspace = (int*)malloc(PCRE2_DFA_WORKSPACE_SIZE * sizeof(int))) == NULL)
-    return NULL;
   if ((result = (struct pcre2_finder*)malloc(sizeof(struct pcre2_finder))) != NULL) {
     result->matchfn = NULL;
     result->matchcallbackdata = NULL;
@@ -51,21 +141,91 @@ DLL_EXPORT_PCRE2_FINDER struct pcre2_finder* pcre2_finder_initialize ()
     result->outputcallbackdata = NULL;
     result->partialmatch = NULL;
     result->partialmatchlen = 0;
+    result->partialmatchalloc = 0;
+    result->partialmatchsearched = 0;
+    result->partialmatchpos = 0;
+    result->inputpos = 0;
+    result->matchpos = 0;
+    result->maxpartialmatch = 0;
+    result->newmaxpartialmatch = 0;
+    result->maxmatchlen = 0;
+    result->newmaxmatchlen = 0;
+    result->derivedmaxlen = 0;
+    result->matchlimit = 0;
+    result->newmatchlimit = 0;
+    result->depthlimit = 0;
+    result->newdepthlimit = 0;
+    result->heaplimit = 0;
+    result->newheaplimit = 0;
+    result->timelimit = 0;
+    result->newtimelimit = 0;
+    result->deadline = 0;
+    result->timesteps = 0;
+    result->limitpolicy = PCRE2_FINDER_LIMIT_FAIL;
+    result->newlimitpolicy = PCRE2_FINDER_LIMIT_FAIL;
     result->re = NULL;
     result->match_data = NULL;
     result->match_context = NULL;
-    result->dfaworkspace = dfaworkspace;
-    result->dfaworkspacesize = PCRE2_DFA_WORKSPACE_SIZE;
+    result->dfaworkspace = NULL;
+    result->dfaworkspacesize = 0;
+    result->engine = PCRE2_FINDER_ENGINE_DFA;
+    result->newengine = PCRE2_FINDER_ENGINE_DFA;
+    result->jit_stack = NULL;
+    result->matchbuffer = NULL;
+    result->matchbufferlen = 0;
+    result->bufferoutput = 0;
+    result->requestedengine = PCRE2_FINDER_ENGINE_DFA;
+    result->mode = PCRE2_FINDER_MODE_LAYERED;
+    result->newmode = PCRE2_FINDER_MODE_LAYERED;
+    result->flags = 0;
+    result->exprs = NULL;
+    result->exprcount = 0;
+    result->useprefilter = 0;
+    result->literals = NULL;
+    result->matchindex = 0;
+    result->collectstats = 0;
+    memset(&result->stats, 0, sizeof(result->stats));
+    result->userdata = NULL;
+    result->shared = 0;
+    memset(&result->batchdata, 0, sizeof(result->batchdata));
+    result->batch = NULL;
+    result->abortdata = 0;
+    result->aborted = &result->abortdata;
+    result->independent = 0;
+    result->threads = 0;
+    result->pipeline = NULL;
+    result->stages = NULL;
     result->next = NULL;
     result->last = result;
   }
   return result;
 }
 
+static int stop_threads (struct pcre2_finder* finder)
+{
+  struct pcre2_finder* current;
+  int status;
+  //wait until the worker threads have processed all data
+  status = pipeline_finish(finder->pipeline);
+  pipeline_cleanup(finder->pipeline);
+  //the expressions no longer use the abort flag of their group
+  for (current = finder; current; current = current->next)
+    current->aborted = &finder->abortdata;
+  if (status == PCRE2_FINDER_ABORTED)
+    finder->abortdata = 1;
+  free(finder->stages);
+  finder->pipeline = NULL;
+  finder->stages = NULL;
+  return status;
+}
+
 DLL_EXPORT_PCRE2_FINDER void pcre2_finder_cleanup (struct pcre2_finder* finder)
 {
   struct pcre2_finder* current;
   struct pcre2_finder* next;
+  int shared = finder->shared;
+  if (finder->pipeline)
+    stop_threads(finder);
   current = finder;
   while (current) {
     next = current->next;
@@ -73,15 +233,238 @@ DLL_EXPORT_PCRE2_FINDER void pcre2_finder_cleanup (struct pcre2_finder* finder)
       free(current->partialmatch);
     if (current->dfaworkspace)
       free(current->dfaworkspace);
-    if (current->match_context)
-      pcre2_match_context_free(current->match_context);
+    if (current->matchbuffer)
+      free(current->matchbuffer);
     if (current->match_data)
       pcre2_match_data_free(current->match_data);
-    if (current->re)
-      pcre2_code_free(current->re);
-    free(current);
+    if (current->match_context)
+      pcre2_match_context_free(current->match_context);
+    //compiled expressions of a stream belong to the finder it was created from
+    if (!current->shared) {
+      if (current->jit_stack)
+        pcre2_jit_stack_free(current->jit_stack);
+      if (current->re)
+        pcre2_code_free(current->re);
+      if (current->literals)
+        aho_corasick_cleanup(current->literals);
+      if (current->exprs) {
+        size_t i;
+        for (i = 0; i < current->exprcount; i++)
+          free(current->exprs[i].expr);
+        free(current->exprs);
+      }
+      free(current);
+    }
     current = next;
   }
+  //the nodes of a stream share the JIT stack and are allocated as a single block
+  if (shared) {
+    if (finder->jit_stack)
+      pcre2_jit_stack_free(finder->jit_stack);
+    free(finder);
+  }
+}
+
+static void set_engine (struct pcre2_finder* finder, int engine)
+{
+  //JIT compile if requested (fall back to DFA matching if JIT is not available, or to pcre2_match() without JIT in simultaneous mode)
+  finder->engine = (finder->exprs || finder->mode == PCRE2_FINDER_MODE_SIMULTANEOUS ? PCRE2_FINDER_ENGINE_NOJIT : PCRE2_FINDER_ENGINE_DFA);
+  if (engine == PCRE2_FINDER_ENGINE_JIT) {
+    if (pcre2_jit_compile(finder->re, PCRE2_JIT_PARTIAL_HARD) == 0 && (finder->jit_stack || (finder->jit_stack = pcre2_jit_stack_create(PCRE2_JIT_STACK_START, PCRE2_JIT_STACK_MAX, NULL)) != NULL)) {
+      pcre2_jit_stack_assign(finder->match_context, NULL, finder->jit_stack);
+      finder->engine = PCRE2_FINDER_ENGINE_JIT;
+    }
+  }
+}
+
+static int dfa_workspace_resize (struct pcre2_finder* finder, size_t size)
+{
+  int* newworkspace;
+  if ((newworkspace = (int*)realloc(finder->dfaworkspace, size * sizeof(int))) == NULL)
+    return -1;
+  finder->dfaworkspace = newworkspace;
+  finder->dfaworkspacesize = size;
+  return 0;
+}
+
+static int dfa_workspace_initialize (struct pcre2_finder* finder)
+{
+  size_t codesize = 0;
+  size_t size;
+  //estimate from the compiled pattern size (each state takes 3 ints in both the current and the next state list)
+  pcre2_pattern_info(finder->re, PCRE2_INFO_SIZE, &codesize);
+  size = 2 + 3 * codesize;
+  if (size < PCRE2_DFA_WORKSPACE_SIZE)
+    size = PCRE2_DFA_WORKSPACE_SIZE;
+  if (size > PCRE2_DFA_WORKSPACE_MAX)
+    size = PCRE2_DFA_WORKSPACE_MAX;
+  //keep the size learned so far
+  if (size <= finder->dfaworkspacesize)
+    return 0;
+  return dfa_workspace_resize(finder, size);
+}
+
+static int dfa_workspace_grow (struct pcre2_finder* finder)
+{
+  if (finder->dfaworkspacesize >= PCRE2_DFA_WORKSPACE_MAX)
+    return -1;
+  return dfa_workspace_resize(finder, (finder->dfaworkspacesize * 2 < PCRE2_DFA_WORKSPACE_MAX ? finder->dfaworkspacesize * 2 : PCRE2_DFA_WORKSPACE_MAX));
+}
+
+static int compile_simultaneous (struct pcre2_finder* finder)
+{
+  //combine all expressions into a single alternation, each branch is tagged with (*MARK:<index>) to identify the expression that matched
+  char* pattern;
+  size_t patternlen;
+  size_t pos;
+  size_t i;
+  int status;
+  PCRE2_SIZE erroroffset;
+  const char* eol = (finder->flags & PCRE2_EXTENDED ? "\n" : "");
+  patternlen = 4;
+  for (i = 0; i < finder->exprcount; i++)
+    patternlen += strlen(finder->exprs[i].expr) + 32;
+  if ((pattern = (char*)malloc(patternlen)) == NULL)
+    return PCRE2_ERROR_NOMEMORY;
+  pos = 0;
+  memcpy(pattern, "(?|", 3);
+  pos += 3;
+  for (i = 0; i < finder->exprcount; i++)
+    pos += sprintf(pattern + pos, "%s(*MARK:%lu)(?:%s%s)", (i ? "|" : ""), (unsigned long)i, finder->exprs[i].expr, eol);
+  pattern[pos++] = ')';
+  if (finder->re)
+    pcre2_code_free(finder->re);
+  finder->re = pcre2_compile((PCRE2_UCHAR*)pattern, pos, finder->flags, &status, &erroroffset, NULL);
+  free(pattern);
+  if (!finder->re)
+    return status;
+  finder->useprefilter = prefilter_initialize(&finder->prefilter, finder->re);
+  set_engine(finder, finder->requestedengine);
+  return 0;
+}
+
+static int has_verbs (const char* expr)
+{
+  //backtracking control verbs like (*MARK), (*PRUNE), (*SKIP) or (*COMMIT) would replace the mark that tags the branch
+  //or affect the other branches of combined expressions (this also catches some harmless constructs like \(* or [(*])
+  return (strstr(expr, "(*") != NULL);
+}
+
+static int append_expr (struct pcre2_finder* finder, const char* expr, pcre2_finder_match_fn matchfn, void* callbackdata, int matchid)
+{
+  struct pcre2_finder_expr* exprs;
+  if ((exprs = (struct pcre2_finder_expr*)realloc(finder->exprs, (finder->exprcount + 1) * sizeof(struct pcre2_finder_expr))) == NULL)
+    return -2;
+  finder->exprs = exprs;
+  if ((exprs[finder->exprcount].expr = strdup(expr)) == NULL)
+    return -2;
+  exprs[finder->exprcount].matchfn = matchfn;
+  exprs[finder->exprcount].matchcallbackdata = callbackdata;
+  exprs[finder->exprcount].matchid = matchid;
+  finder->exprcount++;
+  return 0;
+}
+
+static struct pcre2_finder* new_node (struct pcre2_finder* finder, unsigned int flags)
+{
+  struct pcre2_finder* current = finder->last;
+  //add new instance if needed
+  if (current->re || current->exprs) {
+    if ((current->next = pcre2_finder_initialize()) == NULL)
+      return NULL;
+    current = current->next;
+    current->userdata = finder->userdata;
+    finder->last = current;
+  }
+  current->flags = flags;
+  current->mode = finder->newmode;
+  current->requestedengine = finder->newengine;
+  current->maxpartialmatch = finder->newmaxpartialmatch;
+  current->maxmatchlen = finder->newmaxmatchlen;
+  current->matchlimit = finder->newmatchlimit;
+  current->depthlimit = finder->newdepthlimit;
+  current->heaplimit = finder->newheaplimit;
+  current->timelimit = finder->newtimelimit;
+  current->limitpolicy = finder->newlimitpolicy;
+  return current;
+}
+
+static int same_limits (struct pcre2_finder* current, struct pcre2_finder* finder)
+{
+  return (current->matchlimit == finder->newmatchlimit && current->depthlimit == finder->newdepthlimit && current->heaplimit == finder->newheaplimit && current->timelimit == finder->newtimelimit && current->limitpolicy == finder->newlimitpolicy);
+}
+
+static int time_limit_callout (pcre2_callout_block* block, void* callbackdata);
+
+static int match_context_initialize (struct pcre2_finder* finder)
+{
+  if ((finder->match_context = pcre2_match_context_create(NULL)) == NULL)
+    return -2;
+  if (finder->timelimit)
+    pcre2_set_callout(finder->match_context, time_limit_callout, finder);
+  //zero keeps the default limit PCRE2 was built with
+  if (finder->matchlimit)
+    pcre2_set_match_limit(finder->match_context, finder->matchlimit);
+  if (finder->depthlimit)
+    pcre2_set_depth_limit(finder->match_context, finder->depthlimit);
+  if (finder->heaplimit)
+    pcre2_set_heap_limit(finder->match_context, finder->heaplimit);
+  return 0;
+}
+
+#define PCRE2_LITERAL_FLAGS (PCRE2_CASELESS | PCRE2_LITERAL | PCRE2_UTF | PCRE2_NO_UTF_CHECK | PCRE2_NEVER_UTF | PCRE2_EXTENDED | PCRE2_EXTENDED_MORE | PCRE2_MULTILINE | PCRE2_DOTALL | PCRE2_DOLLAR_ENDONLY | PCRE2_NO_AUTO_CAPTURE | PCRE2_DUPNAMES | PCRE2_NO_AUTO_POSSESS | PCRE2_NO_DOTSTAR_ANCHOR | PCRE2_NO_START_OPTIMIZE | PCRE2_UCP | PCRE2_NEVER_UCP | PCRE2_UNGREEDY | PCRE2_NEVER_BACKSLASH_C | PCRE2_ALLOW_EMPTY_CLASS | PCRE2_ALT_BSUX | PCRE2_ALT_CIRCUMFLEX | PCRE2_ALT_VERBNAMES | PCRE2_MATCH_UNSET_BACKREF)
+
+static char* get_literal (const char* expr, unsigned int flags, size_t* literallen)
+{
+  char* result;
+  const char* p;
+  size_t len = 0;
+  //only options that don't change the meaning of plain characters are allowed
+  if (flags & ~PCRE2_LITERAL_FLAGS)
+    return NULL;
+  if ((result = (char*)malloc(strlen(expr) + 1)) == NULL)
+    return NULL;
+  for (p = expr; *p; p++) {
+    if (!(flags & PCRE2_LITERAL)) {
+      if (*p == '\\') {
+        //only escaped punctuation is a literal character
+        p++;
+        if (!*p || (*p >= '0' && *p <= '9') || (*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z') || (unsigned char)*p >= 0x80)
+          break;
+      } else if (strchr("^$.[|()?*+{", *p)) {
+        break;
+      } else if ((flags & PCRE2_EXTENDED) && (*p == '#' || *p == ' ' || (*p >= '\t' && *p <= '\r'))) {
+        break;
+      }
+    }
+    //non-ASCII characters are left to PCRE2 in UTF mode (validation and caseless matching)
+    if ((flags & PCRE2_UTF) && (unsigned char)*p >= 0x80)
+      break;
+    result[len++] = *p;
+  }
+  if (*p) {
+    free(result);
+    return NULL;
+  }
+  *literallen = len;
+  return result;
+}
+
+static int add_literal (struct pcre2_finder* finder, const char* expr, const char* literal, size_t literallen, unsigned int flags, pcre2_finder_match_fn matchfn, void* callbackdata, int matchid)
+{
+  struct pcre2_finder* current = finder->last;
+  //start a new automaton unless the previous node has literals with the same flags
+  if (!(current->literals && current->mode == PCRE2_FINDER_MODE_SIMULTANEOUS && current->flags == flags)) {
+    if ((current = new_node(finder, flags)) == NULL)
+      return -2;
+    if ((current->literals = aho_corasick_initialize(flags & PCRE2_CASELESS ? 1 : 0)) == NULL)
+      return -2;
+  }
+  if (aho_corasick_add(current->literals, literal, literallen) != 0)
+    return -2;
+  if (literallen > current->derivedmaxlen)
+    current->derivedmaxlen = literallen;
+  return append_expr(current, expr, matchfn, callbackdata, matchid);
 }
 
 DLL_EXPORT_PCRE2_FINDER int pcre2_finder_add_expr (struct pcre2_finder* finder, const char* expr, unsigned int flags, pcre2_finder_match_fn matchfn, void* callbackdata, int matchid)
@@ -89,10 +472,23 @@ DLL_EXPORT_PCRE2_FINDER int pcre2_finder_add_expr (struct pcre2_finder* finder,
   pcre2_code* re;
   int status;
   PCRE2_SIZE erroroffset;
+  char* literal;
+  size_t literallen;
+  size_t length;
   struct pcre2_finder* current = finder->last;
-  //abort if expression is NULL or empty
-  if (!expr || !*expr)
+  //abort if expression is NULL or empty, or if expressions are shared with other streams
+  if (!expr || !*expr || finder->shared)
     return -1;
+  //search literal expressions searched simultaneously using an Aho-Corasick automaton (a single literal is found
+  //faster by PCRE2 skipping ahead with the prefilter)
+  if (finder->newmode == PCRE2_FINDER_MODE_SIMULTANEOUS && (literal = get_literal(expr, flags, &literallen)) != NULL) {
+    status = add_literal(finder, expr, literal, literallen, flags, matchfn, callbackdata, matchid);
+    free(literal);
+    return status;
+  }
+  //a time limit is checked from callouts before each item of the expression, so it also applies within a search
+  if (finder->newtimelimit)
+    flags |= PCRE2_AUTO_CALLOUT;
   //compile regular expression
   if ((re = pcre2_compile((PCRE2_UCHAR*)expr, PCRE2_ZERO_TERMINATED, flags /*PCRE2_EXTENDED | PCRE2_CASELESS | PCRE2_MULTILINE*/, &status, &erroroffset, NULL))  == NULL) {
 /*
@@ -102,14 +498,27 @@ DLL_EXPORT_PCRE2_FINDER int pcre2_finder_add_expr (struct pcre2_finder* finder,
 */
     return 1;
   }
-  //add new instance if needed
-  if (current && current->re) {
-    current->next = pcre2_finder_initialize();
-    current = current->next;
-    finder->last = current;
+  //add to previous expression(s) if they are searched simultaneously with the same flags, engine and limits
+  if (finder->newmode == PCRE2_FINDER_MODE_SIMULTANEOUS && current->exprs && !current->literals && !has_verbs(expr) && current->mode == PCRE2_FINDER_MODE_SIMULTANEOUS && current->flags == flags && current->requestedengine == finder->newengine && current->maxmatchlen == finder->newmaxmatchlen && same_limits(current, finder)) {
+    pcre2_code_free(re);
+    if ((length = pattern_max_length(expr, flags)) > current->derivedmaxlen)
+      current->derivedmaxlen = length;
+    if ((status = append_expr(current, expr, matchfn, callbackdata, matchid)) != 0)
+      return status;
+    //combined expression will be compiled by pcre2_finder_prepare()
+    if (current->re) {
+      pcre2_code_free(current->re);
+      current->re = NULL;
+    }
+    return 0;
+  }
+  if ((current = new_node(finder, flags)) == NULL) {
+    pcre2_code_free(re);
+    return -2;
   }
   //set data
   current->re = re;
+  current->derivedmaxlen = pattern_max_length(expr, flags);
   current->matchfn = matchfn;
   current->matchcallbackdata = callbackdata;
   current->matchid = matchid;
@@ -117,10 +526,141 @@ DLL_EXPORT_PCRE2_FINDER int pcre2_finder_add_expr (struct pcre2_finder* finder,
   //current->match_data = pcre2_match_data_create_from_pattern(current->re, NULL);
   current->match_data = pcre2_match_data_create(1, NULL);
   //create match context data block
-  current->match_context = pcre2_match_context_create(NULL);
+  if (match_context_initialize(current) != 0)
+    return -2;
+  //keep expression to be combined with the next ones in simultaneous mode (expressions with verbs are searched on their own)
+  if (current->mode == PCRE2_FINDER_MODE_SIMULTANEOUS && !has_verbs(expr)) {
+    pcre2_code_free(current->re);
+    current->re = NULL;
+    return append_expr(current, expr, matchfn, callbackdata, matchid);
+  }
+  current->useprefilter = prefilter_initialize(&current->prefilter, current->re);
+  set_engine(current, finder->newengine);
+  if (current->engine == PCRE2_FINDER_ENGINE_DFA && dfa_workspace_initialize(current) != 0)
+    return -2;
+  return 0;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_set_engine (struct pcre2_finder* finder, int engine)
+{
+  if (engine != PCRE2_FINDER_ENGINE_DFA && engine != PCRE2_FINDER_ENGINE_JIT)
+    return -1;
+  finder->newengine = engine;
   return 0;
 }
 
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_set_mode (struct pcre2_finder* finder, int mode)
+{
+  if (mode != PCRE2_FINDER_MODE_LAYERED && mode != PCRE2_FINDER_MODE_SIMULTANEOUS)
+    return -1;
+  finder->newmode = mode;
+  return 0;
+}
+
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_max_partial_match (struct pcre2_finder* finder, size_t maxsize)
+{
+  finder->newmaxpartialmatch = maxsize;
+}
+
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_max_match_length (struct pcre2_finder* finder, size_t maxlen)
+{
+  finder->newmaxmatchlen = maxlen;
+}
+
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_match_limits (struct pcre2_finder* finder, uint32_t matchlimit, uint32_t depthlimit, uint32_t heaplimit)
+{
+  finder->newmatchlimit = matchlimit;
+  finder->newdepthlimit = depthlimit;
+  finder->newheaplimit = heaplimit;
+}
+
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_time_limit (struct pcre2_finder* finder, unsigned long long timelimit)
+{
+  finder->newtimelimit = timelimit;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_set_limit_policy (struct pcre2_finder* finder, int policy)
+{
+  if (policy != PCRE2_FINDER_LIMIT_FAIL && policy != PCRE2_FINDER_LIMIT_SKIP)
+    return -1;
+  finder->newlimitpolicy = policy;
+  return 0;
+}
+
+DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_get_max_match_length (struct pcre2_finder* finder)
+{
+  struct pcre2_finder* current;
+  size_t length;
+  size_t result = 0;
+  for (current = finder; current; current = current->next) {
+    length = (current->maxmatchlen ? current->maxmatchlen : current->derivedmaxlen);
+    if (length == PATTERN_LENGTH_UNBOUNDED)
+      return 0;
+    if (length > result)
+      result = length;
+  }
+  return result;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_set_threads (struct pcre2_finder* finder, unsigned int threads)
+{
+  if (threads > 1 && (!pipeline_available() || finder->shared || finder->batchdata.batchfn))
+    return -1;
+  finder->threads = threads;
+  return 0;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_set_match_batch (struct pcre2_finder* finder, struct pcre2_finder_match* matches, size_t maxmatches, pcre2_finder_batch_fn batchfn, void* callbackdata)
+{
+  if (batchfn && (!matches || maxmatches == 0 || finder->threads > 1))
+    return -1;
+  finder->batchdata.matches = (batchfn ? matches : NULL);
+  finder->batchdata.maxmatches = (batchfn ? maxmatches : 0);
+  finder->batchdata.count = 0;
+  finder->batchdata.batchfn = batchfn;
+  finder->batchdata.callbackdata = callbackdata;
+  return 0;
+}
+
+DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_get_dfa_workspace_size (struct pcre2_finder* finder)
+{
+  struct pcre2_finder* current;
+  size_t result = 0;
+  for (current = finder; current; current = current->next) {
+    if (current->dfaworkspacesize > result)
+      result = current->dfaworkspacesize;
+  }
+  return result;
+}
+
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_stats (struct pcre2_finder* finder, int enable)
+{
+  finder->collectstats = (enable ? 1 : 0);
+}
+
+DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_get_stats (struct pcre2_finder* finder, struct pcre2_finder_stats* stats, size_t count)
+{
+  struct pcre2_finder* current;
+  size_t result = 0;
+  for (current = finder; current; current = current->next) {
+    if (stats && result < count) {
+      stats[result] = current->stats;
+      stats[result].matchid = (current->exprs ? current->exprs[0].matchid : current->matchid);
+      stats[result].exprcount = (current->exprs ? current->exprcount : 1);
+    }
+    result++;
+  }
+  return result;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_jit_available ()
+{
+  uint32_t jit = 0;
+  if (pcre2_config(PCRE2_CONFIG_JIT, &jit) < 0)
+    return 0;
+  return (jit ? 1 : 0);
+}
+
 DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_output_to_stream (void* callbackdata, const char* data, size_t datalen)
 {
   return fwrite(data, 1, datalen, (FILE*)callbackdata);
@@ -131,19 +671,576 @@ DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_output_to_null (void* callbackdata,
   return datalen;
 }
 
-DLL_EXPORT_PCRE2_FINDER int pcre2_finder_open (struct pcre2_finder* finder, pcre2_finder_output_fn outputfn, void* callbackdata)
+static int stage_process (void* stagedata, const char* data, size_t datalen);
+
+static size_t stage_output (void* callbackdata, const char* data, size_t datalen)
+{
+  struct pcre2_finder_stage* stage = (struct pcre2_finder_stage*)callbackdata;
+  //data is copied into the ring buffer of the next group, so output barriers don't need to be passed on
+  if (data && datalen)
+    pipeline_write(stage->pipeline, stage->index, data, datalen);
+  return datalen;
+}
+
+static int start_threads (struct pcre2_finder* finder)
+{
+  struct pcre2_finder* current;
+  size_t nodes = 0;
+  size_t groups;
+  size_t end;
+  size_t i;
+  size_t j;
+  for (current = finder; current; current = current->next)
+    nodes++;
+  groups = (finder->threads < nodes ? finder->threads : nodes);
+  if ((finder->stages = (struct pcre2_finder_stage*)malloc(groups * sizeof(struct pcre2_finder_stage))) == NULL)
+    return -1;
+  if ((finder->pipeline = pipeline_create(groups, PIPELINE_RING_SIZE)) == NULL) {
+    free(finder->stages);
+    finder->stages = NULL;
+    return -1;
+  }
+  //split the chain into groups of consecutive expressions of (nearly) the same size
+  current = finder;
+  j = 0;
+  for (i = 0; i < groups; i++) {
+    finder->stages[i].first = current;
+    finder->stages[i].pipeline = finder->pipeline;
+    finder->stages[i].index = i;
+    end = (i + 1) * nodes / groups;
+    while (++j < end)
+      current = current->next;
+    finder->stages[i].last = current;
+    finder->stages[i].aborted = 0;
+    //the expressions of a group only share an abort flag with each other, aborting one group stops the pipeline
+    for (current = finder->stages[i].first; current != finder->stages[i].last->next; current = current->next)
+      current->aborted = &finder->stages[i].aborted;
+    current = finder->stages[i].last->next;
+    pipeline_set_stage(finder->pipeline, i, stage_process, &finder->stages[i]);
+  }
+  //the last expression of each group outputs to the ring buffer of the next group (unless each group searches the input)
+  for (i = 0; i + 1 < groups && !finder->independent; i++) {
+    finder->stages[i].last->outputfn = stage_output;
+    finder->stages[i].last->outputcallbackdata = &finder->stages[i + 1];
+  }
+  if (pipeline_start(finder->pipeline) != 0) {
+    stop_threads(finder);
+    return -1;
+  }
+  return 0;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_prepare (struct pcre2_finder* finder)
+{
+  struct pcre2_finder* current;
+  //streams were created from prepared expressions
+  if (finder->shared)
+    return 0;
+  for (current = finder; current; current = current->next) {
+    //build automaton for literals
+    if (current->literals) {
+      if (aho_corasick_build(current->literals) != 0)
+        return -1;
+    //compile expressions to be searched simultaneously
+    } else if (current->exprs && !current->re) {
+      if (compile_simultaneous(current) != 0)
+        return -1;
+    }
+  }
+  return 0;
+}
+
+DLL_EXPORT_PCRE2_FINDER struct pcre2_finder* pcre2_finder_create_stream (struct pcre2_finder* finder)
+{
+  struct pcre2_finder* result;
+  struct pcre2_finder* current;
+  size_t nodes = 0;
+  size_t i;
+  int usejit = 0;
+  if (pcre2_finder_prepare(finder) != 0)
+    return NULL;
+  for (current = finder; current; current = current->next) {
+    nodes++;
+    if (current->engine == PCRE2_FINDER_ENGINE_JIT)
+      usejit = 1;
+  }
+  //copy the nodes in a single block, sharing the compiled expressions and resetting the state of the stream
+  if ((result = (struct pcre2_finder*)malloc(nodes * sizeof(struct pcre2_finder))) == NULL)
+    return NULL;
+  for (current = finder, i = 0; current; current = current->next, i++) {
+    memcpy(&result[i], current, sizeof(struct pcre2_finder));
+    result[i].outputfn = NULL;
+    result[i].outputcallbackdata = NULL;
+    result[i].partialmatch = NULL;
+    result[i].partialmatchlen = 0;
+    result[i].partialmatchalloc = 0;
+    result[i].partialmatchsearched = 0;
+    result[i].partialmatchpos = 0;
+    result[i].inputpos = 0;
+    result[i].matchpos = 0;
+    result[i].match_data = NULL;
+    result[i].match_context = NULL;
+    result[i].dfaworkspace = NULL;
+    result[i].dfaworkspacesize = 0;
+    result[i].jit_stack = NULL;
+    result[i].matchbuffer = NULL;
+    result[i].matchbufferlen = 0;
+    result[i].bufferoutput = 0;
+    result[i].matchindex = 0;
+    memset(&result[i].stats, 0, sizeof(result[i].stats));
+    memset(&result[i].batchdata, 0, sizeof(result[i].batchdata));
+    result[i].batch = NULL;
+    result[i].abortdata = 0;
+    result[i].aborted = &result->abortdata;
+    result[i].shared = 1;
+    result[i].threads = 0;
+    result[i].pipeline = NULL;
+    result[i].stages = NULL;
+    result[i].next = (i + 1 < nodes ? &result[i + 1] : NULL);
+    result[i].last = &result[nodes - 1];
+  }
+  //the nodes are searched one after the other, so a single JIT stack is enough for the whole stream
+  if (usejit && (result->jit_stack = pcre2_jit_stack_create(PCRE2_JIT_STACK_START, PCRE2_JIT_STACK_MAX, NULL)) == NULL) {
+    pcre2_finder_cleanup(result);
+    return NULL;
+  }
+  for (current = finder, i = 0; current; current = current->next, i++) {
+    if (result[i].re && !result[i].literals) {
+      //copy the match context to keep the limits of the expression
+      if ((result[i].match_data = pcre2_match_data_create(1, NULL)) == NULL || (result[i].match_context = pcre2_match_context_copy(current->match_context)) == NULL) {
+        pcre2_finder_cleanup(result);
+        return NULL;
+      }
+      if (result[i].engine == PCRE2_FINDER_ENGINE_JIT)
+        pcre2_jit_stack_assign(result[i].match_context, NULL, result->jit_stack);
+      if (result[i].timelimit)
+        pcre2_set_callout(result[i].match_context, time_limit_callout, &result[i]);
+      if (result[i].engine == PCRE2_FINDER_ENGINE_DFA && dfa_workspace_initialize(&result[i]) != 0) {
+        pcre2_finder_cleanup(result);
+        return NULL;
+      }
+    }
+  }
+  return result;
+}
+
+DLL_EXPORT_PCRE2_FINDER void pcre2_finder_set_user_data (struct pcre2_finder* finder, void* userdata)
+{
+  struct pcre2_finder* current;
+  for (current = finder; current; current = current->next)
+    current->userdata = userdata;
+}
+
+DLL_EXPORT_PCRE2_FINDER void* pcre2_finder_get_user_data (struct pcre2_finder* finder)
+{
+  return finder->userdata;
+}
+
+DLL_EXPORT_PCRE2_FINDER unsigned long long pcre2_finder_get_match_offset (struct pcre2_finder* finder)
+{
+  return finder->matchpos;
+}
+
+DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_get_pending (struct pcre2_finder* finder)
+{
+  struct pcre2_finder* current;
+  size_t result = 0;
+  for (current = finder; current; current = current->next)
+    result += current->partialmatchlen;
+  return result;
+}
+
+#define PCRE2_FINDER_CACHE_MAGIC "P2FCACHE"
+#define PCRE2_FINDER_CACHE_FORMAT 2
+#define PCRE2_FINDER_CACHE_NOCODE 0xFFFFFFFF
+#define PCRE2_FINDER_CACHE_ALIGN(n) (((n) + 7) & ~(uint64_t)7)
+
+//cache file layout: header, node records each followed by their expression records, serialized compiled expressions
+struct pcre2_finder_cache_header {
+  char magic[8];
+  uint32_t format;
+  uint32_t nodecount;
+  uint64_t key;
+  char pcre2version[32];
+  uint64_t codesoffset;
+  uint64_t codessize;
+};
+
+struct pcre2_finder_cache_node {
+  uint32_t flags;
+  int32_t mode;
+  int32_t engine;
+  int32_t matchid;
+  uint32_t literals;
+  uint32_t codeindex;
+  uint64_t exprcount;
+  uint64_t maxmatchlen;
+  uint64_t maxpartialmatch;
+  uint64_t derivedmaxlen;
+  uint32_t matchlimit;
+  uint32_t depthlimit;
+  uint32_t heaplimit;
+  int32_t limitpolicy;
+  uint64_t timelimit;
+};
+
+struct pcre2_finder_cache_expr {
+  int32_t matchid;
+  uint32_t exprlen;
+};
+
+static void cache_get_version (char* version)
+{
+  memset(version, 0, 32);
+  pcre2_config(PCRE2_CONFIG_VERSION, version);
+}
+
+static int cache_write (FILE* dst, const void* data, size_t datalen)
+{
+  static const char padding[8] = {0};
+  //keep all records aligned so they can be used directly from a memory mapped file
+  if (datalen && fwrite(data, 1, datalen, dst) != datalen)
+    return -1;
+  if (PCRE2_FINDER_CACHE_ALIGN(datalen) > datalen && fwrite(padding, 1, PCRE2_FINDER_CACHE_ALIGN(datalen) - datalen, dst) != PCRE2_FINDER_CACHE_ALIGN(datalen) - datalen)
+    return -1;
+  return 0;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_save (struct pcre2_finder* finder, const char* filename, unsigned long long key)
+{
+  struct pcre2_finder_cache_header header;
+  struct pcre2_finder_cache_node node;
+  struct pcre2_finder_cache_expr expr;
+  struct pcre2_finder* current;
+  const pcre2_code** codes;
+  uint8_t* codesdata = NULL;
+  PCRE2_SIZE codessize = 0;
+  uint64_t offset;
+  uint32_t codecount = 0;
+  uint32_t nodecount = 0;
+  char* tmpfilename;
+  FILE* dst;
+  size_t i;
+  int status = 0;
+  //the combined expressions are stored as well
+  if (pcre2_finder_prepare(finder) != 0)
+    return -1;
+  for (current = finder; current; current = current->next)
+    nodecount++;
+  if ((codes = (const pcre2_code**)malloc(nodecount * sizeof(pcre2_code*))) == NULL)
+    return -2;
+  offset = sizeof(header);
+  for (current = finder; current; current = current->next) {
+    if (current->re && !current->literals)
+      codes[codecount++] = current->re;
+    offset += sizeof(node);
+    for (i = 0; i < current->exprcount; i++)
+      offset += sizeof(expr) + PCRE2_FINDER_CACHE_ALIGN(strlen(current->exprs[i].expr) + 1);
+  }
+  //serialize all compiled expressions together (this also stores the character tables only once)
+  if (codecount && pcre2_serialize_encode(codes, codecount, &codesdata, &codessize, NULL) < 0) {
+    free(codes);
+    return -1;
+  }
+  free(codes);
+  //write to a temporary file that replaces the cache file when complete
+  if ((tmpfilename = (char*)malloc(strlen(filename) + 5)) == NULL) {
+    pcre2_serialize_free(codesdata);
+    return -2;
+  }
+  strcpy(tmpfilename, filename);
+  strcat(tmpfilename, ".tmp");
+  if ((dst = fopen(tmpfilename, "wb")) == NULL) {
+    pcre2_serialize_free(codesdata);
+    free(tmpfilename);
+    return -3;
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PCRE2_FINDER_CACHE_MAGIC, sizeof(header.magic));
+  header.format = PCRE2_FINDER_CACHE_FORMAT;
+  header.nodecount = nodecount;
+  header.key = key;
+  cache_get_version(header.pcre2version);
+  header.codesoffset = offset;
+  header.codessize = codessize;
+  status = cache_write(dst, &header, sizeof(header));
+  codecount = 0;
+  for (current = finder; current && status == 0; current = current->next) {
+    memset(&node, 0, sizeof(node));
+    node.flags = current->flags;
+    node.mode = current->mode;
+    node.engine = current->requestedengine;
+    node.matchid = current->matchid;
+    node.literals = (current->literals ? 1 : 0);
+    node.codeindex = (current->re && !current->literals ? codecount++ : PCRE2_FINDER_CACHE_NOCODE);
+    node.exprcount = current->exprcount;
+    node.maxmatchlen = current->maxmatchlen;
+    node.maxpartialmatch = current->maxpartialmatch;
+    node.derivedmaxlen = current->derivedmaxlen;
+    node.matchlimit = current->matchlimit;
+    node.depthlimit = current->depthlimit;
+    node.heaplimit = current->heaplimit;
+    node.limitpolicy = current->limitpolicy;
+    node.timelimit = current->timelimit;
+    status = cache_write(dst, &node, sizeof(node));
+    for (i = 0; i < current->exprcount && status == 0; i++) {
+      expr.matchid = current->exprs[i].matchid;
+      expr.exprlen = (uint32_t)strlen(current->exprs[i].expr);
+      if ((status = cache_write(dst, &expr, sizeof(expr))) == 0)
+        status = cache_write(dst, current->exprs[i].expr, expr.exprlen + 1);
+    }
+  }
+  if (status == 0 && codessize && fwrite(codesdata, 1, codessize, dst) != codessize)
+    status = -1;
+  if (fclose(dst) != 0)
+    status = -1;
+  pcre2_serialize_free(codesdata);
+#ifdef _WIN32
+  if (status == 0)
+    remove(filename);
+#endif
+  if (status != 0 || rename(tmpfilename, filename) != 0) {
+    remove(tmpfilename);
+    status = -3;
+  }
+  free(tmpfilename);
+  return status;
+}
+
+static int load_node (struct pcre2_finder* finder, const struct pcre2_finder_cache_node* node, const char* data, pcre2_code* re, pcre2_finder_match_fn matchfn, void* callbackdata)
+{
+  struct pcre2_finder_cache_expr expr;
+  char* literal;
+  size_t literallen;
+  size_t i;
+  finder->flags = node->flags;
+  finder->mode = node->mode;
+  finder->requestedengine = node->engine;
+  finder->maxmatchlen = node->maxmatchlen;
+  finder->maxpartialmatch = node->maxpartialmatch;
+  finder->derivedmaxlen = node->derivedmaxlen;
+  finder->matchlimit = node->matchlimit;
+  finder->depthlimit = node->depthlimit;
+  finder->heaplimit = node->heaplimit;
+  finder->limitpolicy = node->limitpolicy;
+  finder->timelimit = node->timelimit;
+  finder->matchfn = matchfn;
+  finder->matchcallbackdata = callbackdata;
+  finder->matchid = node->matchid;
+  finder->re = re;
+  if (node->literals && (finder->literals = aho_corasick_initialize(node->flags & PCRE2_CASELESS ? 1 : 0)) == NULL)
+    return -2;
+  for (i = 0; i < node->exprcount; i++) {
+    memcpy(&expr, data, sizeof(expr));
+    data += sizeof(expr);
+    if (append_expr(finder, data, matchfn, callbackdata, expr.matchid) != 0)
+      return -2;
+    //literal automata are rebuilt as this is much faster than compiling
+    if (finder->literals) {
+      if ((literal = get_literal(data, node->flags, &literallen)) == NULL)
+        return -4;
+      if (aho_corasick_add(finder->literals, literal, literallen) != 0) {
+        free(literal);
+        return -2;
+      }
+      free(literal);
+    }
+    data += PCRE2_FINDER_CACHE_ALIGN(expr.exprlen + 1);
+  }
+  if (finder->literals)
+    return (aho_corasick_build(finder->literals) == 0 ? 0 : -2);
+  if (!finder->re)
+    return 0;
+  if ((finder->match_data = pcre2_match_data_create(1, NULL)) == NULL || match_context_initialize(finder) != 0)
+    return -2;
+  finder->useprefilter = prefilter_initialize(&finder->prefilter, finder->re);
+  //JIT compiled code can't be serialized, so it is compiled again
+  set_engine(finder, finder->requestedengine);
+  if (finder->engine == PCRE2_FINDER_ENGINE_DFA && dfa_workspace_initialize(finder) != 0)
+    return -2;
+  return 0;
+}
+
+static int load_cache (struct pcre2_finder* finder, const char* data, size_t datalen, unsigned long long key, pcre2_finder_match_fn matchfn, void* callbackdata)
+{
+  struct pcre2_finder_cache_header header;
+  struct pcre2_finder_cache_node node;
+  struct pcre2_finder_cache_expr expr;
+  struct pcre2_finder* current = finder;
+  pcre2_code** codes = NULL;
+  char* used = NULL;
+  char version[32];
+  int32_t codecount = 0;
+  uint64_t pos;
+  uint32_t n;
+  size_t i;
+  int status = 0;
+  //check if the cache was made for these expressions with this version of PCRE2
+  if (datalen < sizeof(header))
+    return -4;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, PCRE2_FINDER_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.format != PCRE2_FINDER_CACHE_FORMAT || header.nodecount == 0 || header.codesoffset > datalen || header.codessize > datalen - header.codesoffset || (header.codessize && header.codessize < 32))
+    return -4;
+  cache_get_version(version);
+  if (header.key != key || memcmp(header.pcre2version, version, sizeof(version)) != 0)
+    return 1;
+  //check that all records are within the data before changing anything
+  pos = sizeof(header);
+  for (n = 0; n < header.nodecount; n++) {
+    if (header.codesoffset - pos < sizeof(node))
+      return -4;
+    memcpy(&node, data + pos, sizeof(node));
+    pos += sizeof(node);
+    if ((node.codeindex != PCRE2_FINDER_CACHE_NOCODE && node.literals) || node.exprcount > header.codesoffset)
+      return -4;
+    for (i = 0; i < node.exprcount; i++) {
+      if (header.codesoffset - pos < sizeof(expr))
+        return -4;
+      memcpy(&expr, data + pos, sizeof(expr));
+      pos += sizeof(expr);
+      if (header.codesoffset - pos < PCRE2_FINDER_CACHE_ALIGN((uint64_t)expr.exprlen + 1) || data[pos + expr.exprlen] != 0 || strlen(data + pos) != expr.exprlen)
+        return -4;
+      pos += PCRE2_FINDER_CACHE_ALIGN((uint64_t)expr.exprlen + 1);
+    }
+  }
+  //decode the compiled expressions straight from the (memory mapped) data
+  if (header.codessize) {
+    if ((codecount = pcre2_serialize_get_number_of_codes((const uint8_t*)data + header.codesoffset)) <= 0)
+      return -4;
+    if ((codes = (pcre2_code**)calloc(codecount, sizeof(pcre2_code*))) == NULL || (used = (char*)calloc(codecount, 1)) == NULL) {
+      free(codes);
+      return -2;
+    }
+    if (pcre2_serialize_decode(codes, codecount, (const uint8_t*)data + header.codesoffset, NULL) != codecount) {
+      free(codes);
+      free(used);
+      return -4;
+    }
+  }
+  //rebuild the chain of expressions
+  pos = sizeof(header);
+  for (n = 0; n < header.nodecount && status == 0; n++) {
+    memcpy(&node, data + pos, sizeof(node));
+    pos += sizeof(node);
+    if (node.codeindex != PCRE2_FINDER_CACHE_NOCODE && (node.codeindex >= (uint32_t)codecount || used[node.codeindex])) {
+      status = -4;
+      break;
+    }
+    if (n > 0) {
+      if ((current->next = pcre2_finder_initialize()) == NULL) {
+        status = -2;
+        break;
+      }
+      current = current->next;
+      current->userdata = finder->userdata;
+      finder->last = current;
+    }
+    if (node.codeindex != PCRE2_FINDER_CACHE_NOCODE)
+      used[node.codeindex] = 1;
+    status = load_node(current, &node, data + pos, (node.codeindex != PCRE2_FINDER_CACHE_NOCODE ? codes[node.codeindex] : NULL), matchfn, callbackdata);
+    for (i = 0; i < node.exprcount; i++) {
+      memcpy(&expr, data + pos, sizeof(expr));
+      pos += sizeof(expr) + PCRE2_FINDER_CACHE_ALIGN((uint64_t)expr.exprlen + 1);
+    }
+  }
+  //free compiled expressions that weren't taken over
+  for (i = 0; i < (size_t)codecount; i++) {
+    if (!used[i])
+      pcre2_code_free(codes[i]);
+  }
+  free(codes);
+  free(used);
+  return status;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_load (struct pcre2_finder* finder, const char* filename, unsigned long long key, pcre2_finder_match_fn matchfn, void* callbackdata)
+{
+  int status;
+#ifdef _WIN32
+  FILE* src;
+  char* data;
+  long datalen;
+#else
+  int fd;
+  struct stat st;
+  void* data;
+#endif
+  //only load into a pcre2_finder object without expressions
+  if (finder->shared || finder->re || finder->exprs || finder->literals || finder->next)
+    return -1;
+#ifdef _WIN32
+  if ((src = fopen(filename, "rb")) == NULL)
+    return -3;
+  if (fseek(src, 0, SEEK_END) != 0 || (datalen = ftell(src)) < 0 || fseek(src, 0, SEEK_SET) != 0) {
+    fclose(src);
+    return -3;
+  }
+  if ((data = (char*)malloc(datalen ? datalen : 1)) == NULL) {
+    fclose(src);
+    return -2;
+  }
+  if (fread(data, 1, datalen, src) != (size_t)datalen) {
+    free(data);
+    fclose(src);
+    return -3;
+  }
+  fclose(src);
+  status = load_cache(finder, data, datalen, key, matchfn, callbackdata);
+  free(data);
+#else
+  //map the cache file instead of reading it
+  if ((fd = open(filename, O_RDONLY)) == -1)
+    return -3;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -3;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return -4;
+  }
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return -3;
+  status = load_cache(finder, (const char*)data, st.st_size, key, matchfn, callbackdata);
+  munmap(data, st.st_size);
+#endif
+  return status;
+}
+
+static int open_stream (struct pcre2_finder* finder, pcre2_finder_output_fn outputfn, void* callbackdata, int independent)
 {
   struct pcre2_finder* current = finder;
   //fail if no expressions are set
-  if (finder->last == finder && !finder->re)
+  if (finder->last == finder && !finder->re && !finder->exprs)
     return -1;
   //fail if no output function is set
   if (!outputfn)
     return -2;
+  //stop worker threads of a previous stream that wasn't closed
+  if (finder->pipeline)
+    stop_threads(finder);
+  //compile what is left to compile
+  if (pcre2_finder_prepare(finder) != 0)
+    return -3;
   //loop through expressions
   while (current) {
+    //start collecting statistics for this stream
+    current->collectstats = finder->collectstats;
+    memset(&current->stats, 0, sizeof(current->stats));
+    //all expressions add their matches to the same batch
+    current->batch = (finder->batchdata.batchfn ? &finder->batchdata : NULL);
+    current->aborted = &finder->abortdata;
+    current->independent = independent;
+    //offsets of matches start from the beginning of the stream
+    current->inputpos = 0;
+    current->partialmatchpos = 0;
     //set output function (daisy chain with next if not last in chain, otherwise set final output function)
-    if (current->next) {
+    if (independent) {
+      current->outputfn = pcre2_finder_output_to_null;
+      current->outputcallbackdata = NULL;
+    } else if (current->next) {
       current->outputfn = (pcre2_finder_output_fn)&pcre2_finder_process;
       current->outputcallbackdata = current->next;
     } else {
@@ -153,53 +1250,373 @@ DLL_EXPORT_PCRE2_FINDER int pcre2_finder_open (struct pcre2_finder* finder, pcre
     //continue with next expression
     current = current->next;
   }
+  finder->batchdata.finder = finder;
+  finder->batchdata.count = 0;
+  finder->abortdata = 0;
+  //search groups of expressions on worker threads
+  if (finder->threads > 1 && start_threads(finder) != 0)
+    return -4;
+  return 0;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_open (struct pcre2_finder* finder, pcre2_finder_output_fn outputfn, void* callbackdata)
+{
+  return open_stream(finder, outputfn, callbackdata, 0);
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_open_independent (struct pcre2_finder* finder)
+{
+  return open_stream(finder, pcre2_finder_output_to_null, NULL, 1);
+}
+
+static unsigned long long get_time_ns ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER counter;
+  static LARGE_INTEGER frequency = {0};
+  if (!frequency.QuadPart)
+    QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (unsigned long long)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL + (unsigned long long)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / frequency.QuadPart;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+static unsigned long long stats_search_start (struct pcre2_finder* finder)
+{
+  //only read the clock when collecting statistics
+  return (finder->collectstats ? get_time_ns() : 0);
+}
+
+static void stats_search_end (struct pcre2_finder* finder, unsigned long long start)
+{
+  if (finder->collectstats) {
+    finder->stats.searches++;
+    finder->stats.searchtime += get_time_ns() - start;
+  }
+}
+
+static int deadline_passed (struct pcre2_finder* finder)
+{
+  //only read the clock when a time limit is set
+  return (finder->deadline && get_time_ns() > finder->deadline);
+}
+
+#define PCRE2_FINDER_TIME_STEPS 256
+
+static int time_limit_callout (pcre2_callout_block* block, void* callbackdata)
+{
+  struct pcre2_finder* finder = (struct pcre2_finder*)callbackdata;
+  //only read the clock every so many steps, a negative value makes PCRE2 abandon the search and return it
+  if (++finder->timesteps % PCRE2_FINDER_TIME_STEPS == 0 && deadline_passed(finder))
+    return PCRE2_FINDER_ERROR_TIMELIMIT;
   return 0;
 }
 
-char* partialmatch_append (struct pcre2_finder* finder, const char* s, size_t slen)
+static int limit_skip (struct pcre2_finder* finder, int status)
 {
-  if ((finder->partialmatch = (char*)realloc(finder->partialmatch, finder->partialmatchlen + slen)) == NULL) {
-    finder->partialmatchlen = 0;
-    return NULL;
+  //check if data on which a limit was hit is treated as non-matching data instead of returning the error
+  if (finder->limitpolicy != PCRE2_FINDER_LIMIT_SKIP)
+    return 0;
+  switch (status) {
+    case PCRE2_ERROR_MATCHLIMIT :
+    case PCRE2_ERROR_DEPTHLIMIT :
+    case PCRE2_ERROR_HEAPLIMIT :
+    case PCRE2_ERROR_JIT_STACKLIMIT :
+    case PCRE2_FINDER_ERROR_TIMELIMIT :
+      if (finder->collectstats)
+        finder->stats.limitskips++;
+      return 1;
+    default :
+      return 0;
+  }
+}
+
+static size_t output_data (struct pcre2_finder* finder, const char* data, size_t datalen)
+{
+  //non-matching data isn't passed on when each expression searches the input
+  if (finder->independent)
+    return datalen;
+  if (finder->collectstats)
+    finder->stats.bytesout += datalen;
+  return (*finder->outputfn)(finder->outputcallbackdata, data, datalen);
+}
+
+static void batch_deliver (struct pcre2_finder_batch* batch)
+{
+  //pass the matches collected so far to the batch function
+  if (batch->count) {
+    if ((*batch->batchfn)(batch->finder, batch->matches, batch->count, batch->callbackdata) != 0)
+      *batch->finder->aborted = 1;
+    batch->count = 0;
+  }
+}
+
+static void output_barrier (struct pcre2_finder* finder)
+{
+  //tell the output function that data previously passed from internal buffers is about to be overwritten
+  //(matches in the batch may point to that data as well)
+  if (finder->bufferoutput) {
+    if (finder->batch)
+      batch_deliver(finder->batch);
+    (*finder->outputfn)(finder->outputcallbackdata, NULL, 0);
+    finder->bufferoutput = 0;
+  }
+}
+
+static char* partialmatch_append (struct pcre2_finder* finder, const char* s, size_t slen)
+{
+  output_barrier(finder);
+  //grow buffer geometrically, it is kept for the next partial match
+  if (finder->partialmatchlen + slen > finder->partialmatchalloc) {
+    char* newbuffer;
+    size_t newalloc = (finder->partialmatchalloc ? finder->partialmatchalloc : PARTIALMATCH_MIN_ALLOC);
+    while (newalloc < finder->partialmatchlen + slen)
+      newalloc *= 2;
+    if ((newbuffer = (char*)realloc(finder->partialmatch, newalloc)) == NULL) {
+      finder->partialmatchlen = 0;
+      return NULL;
+    }
+    finder->partialmatch = newbuffer;
+    finder->partialmatchalloc = newalloc;
   }
   memcpy(finder->partialmatch + finder->partialmatchlen, s, slen);
   finder->partialmatchlen += slen;
   return finder->partialmatch;
 }
 
-void partialmatch_clear (struct pcre2_finder* finder)
+static void partialmatch_clear (struct pcre2_finder* finder)
 {
-  if (finder->partialmatch)
-    free(finder->partialmatch);
-  finder->partialmatch = NULL;
   finder->partialmatchlen = 0;
 }
 
-DLL_EXPORT_PCRE2_FINDER int pcre2_finder_process (struct pcre2_finder* finder, const char* data, size_t datalen)
+static void batch_add (struct pcre2_finder_batch* batch, const char* data, size_t datalen, unsigned long long offset, int matchid)
+{
+  struct pcre2_finder_match* match = &batch->matches[batch->count++];
+  match->data = data;
+  match->datalen = datalen;
+  match->offset = offset;
+  match->matchid = matchid;
+  if (batch->count == batch->maxmatches)
+    batch_deliver(batch);
+}
+
+static void report_match (struct pcre2_finder* finder, const char* data, size_t datalen, unsigned long long offset)
+{
+  struct pcre2_finder_expr* expr;
+  //pass the data on if the expression that matched can't be identified instead of losing it
+  if (finder->exprs && finder->matchindex >= finder->exprcount) {
+    output_data(finder, data, datalen);
+    return;
+  }
+  if (finder->collectstats)
+    finder->stats.matches++;
+  finder->matchpos = offset;
+  //call the match function of the expression that matched, or add the match to the batch (a non-zero result stops all expressions of the stream)
+  if (!finder->exprs) {
+    if (finder->batch)
+      batch_add(finder->batch, data, datalen, offset, finder->matchid);
+    else if ((*finder->matchfn)(finder, data, datalen, finder->matchcallbackdata, finder->matchid) != 0)
+      *finder->aborted = 1;
+    return;
+  }
+  expr = &finder->exprs[finder->matchindex];
+  if (finder->batch)
+    batch_add(finder->batch, data, datalen, offset, expr->matchid);
+  else if ((*expr->matchfn)(finder, data, datalen, expr->matchcallbackdata, expr->matchid) != 0)
+    *finder->aborted = 1;
+}
+
+static int call_dfa_match (struct pcre2_finder* finder, const char* data, size_t datalen, size_t start_offset, uint32_t options)
+{
+  int status;
+  unsigned long long start = stats_search_start(finder);
+  status = pcre2_dfa_match(finder->re, (PCRE2_UCHAR*)data, datalen, start_offset, options, finder->match_data, finder->match_context, finder->dfaworkspace, finder->dfaworkspacesize);
+  stats_search_end(finder, start);
+  return status;
+}
+
+static int dfa_match (struct pcre2_finder* finder, const char* data, size_t datalen, size_t start_offset)
+{
+  int status;
+  //grow the workspace when it is too small and try again (the size is kept for later searches)
+  while ((status = call_dfa_match(finder, data, datalen, start_offset, PCRE2_OPTIONS)) == PCRE2_ERROR_DFA_WSSIZE) {
+    if (dfa_workspace_grow(finder) != 0)
+      break;
+  }
+  return status;
+}
+
+static int dfa_match_restart (struct pcre2_finder* finder, const char* data, size_t datalen)
+{
+  int status;
+  while ((status = call_dfa_match(finder, data, datalen, 0, PCRE2_OPTIONS | PCRE2_DFA_RESTART)) == PCRE2_ERROR_DFA_WSSIZE) {
+    if (dfa_workspace_grow(finder) != 0)
+      break;
+    //the layout of the workspace depends on its size, so rebuild the state to restart from by searching the carried partial match again
+    if ((status = dfa_match(finder, finder->partialmatch, finder->partialmatchlen, 0)) != PCRE2_ERROR_PARTIAL || pcre2_get_ovector_pointer(finder->match_data)[0] != 0)
+      return (status < 0 && status != PCRE2_ERROR_PARTIAL && status != PCRE2_ERROR_NOMATCH ? status : PCRE2_ERROR_DFA_WSSIZE);
+  }
+  return status;
+}
+
+static int search_dfa (struct pcre2_finder* finder, const char* data, size_t datalen, size_t start_offset)
+{
+  //skip to the first position where a match can start
+  if (finder->useprefilter && (start_offset = prefilter_find(&finder->prefilter, data, datalen, start_offset)) >= datalen)
+    return PCRE2_ERROR_NOMATCH;
+  if (deadline_passed(finder))
+    return PCRE2_FINDER_ERROR_TIMELIMIT;
+  return dfa_match(finder, data, datalen, start_offset);
+}
+
+static int search (struct pcre2_finder* finder, const char* data, size_t datalen, size_t start_offset, int final, size_t* ovector)
+{
+  int status;
+  PCRE2_SIZE* match_ovector;
+  PCRE2_SPTR mark;
+  unsigned long long start;
+  //search literals
+  if (finder->literals) {
+    start = stats_search_start(finder);
+    status = aho_corasick_search(finder->literals, data, datalen, start_offset, final, &ovector[0], &ovector[1], &finder->matchindex);
+    stats_search_end(finder, start);
+    switch (status) {
+      case AHO_CORASICK_MATCH :
+        return 1;
+      case AHO_CORASICK_PARTIAL :
+        return PCRE2_ERROR_PARTIAL;
+      default :
+        return PCRE2_ERROR_NOMATCH;
+    }
+  }
+  //skip to the first position where a match can start
+  if (finder->useprefilter && (start_offset = prefilter_find(&finder->prefilter, data, datalen, start_offset)) >= datalen)
+    return PCRE2_ERROR_NOMATCH;
+  if (deadline_passed(finder))
+    return PCRE2_FINDER_ERROR_TIMELIMIT;
+  start = stats_search_start(finder);
+  status = pcre2_match(finder->re, (PCRE2_UCHAR*)data, datalen, start_offset, (final ? PCRE2_NOTEMPTY : PCRE2_MATCH_OPTIONS), finder->match_data, finder->match_context);
+  stats_search_end(finder, start);
+  if (status >= 0 || status == PCRE2_ERROR_PARTIAL) {
+    match_ovector = pcre2_get_ovector_pointer(finder->match_data);
+    ovector[0] = match_ovector[0];
+    ovector[1] = match_ovector[1];
+    //get index of combined expression that matched from its mark
+    if (status >= 0 && finder->exprs)
+      finder->matchindex = ((mark = pcre2_get_mark(finder->match_data)) != NULL ? strtoul((const char*)mark, NULL, 10) : finder->exprcount);
+  }
+  return status;
+}
+
+static int search_engine (struct pcre2_finder* finder, const char* data, size_t datalen, size_t start_offset, size_t* ovector)
+{
+  int status;
+  PCRE2_SIZE* match_ovector;
+  //search with the engine used by process_dfa() or process_search()
+  if (finder->literals || finder->engine != PCRE2_FINDER_ENGINE_DFA)
+    return search(finder, data, datalen, start_offset, 0, ovector);
+  if ((status = search_dfa(finder, data, datalen, start_offset)) >= 0 || status == PCRE2_ERROR_PARTIAL) {
+    match_ovector = pcre2_get_ovector_pointer(finder->match_data);
+    ovector[0] = match_ovector[0];
+    ovector[1] = match_ovector[1];
+  }
+  return status;
+}
+
+static void partialmatch_release (struct pcre2_finder* finder)
+{
+  int status;
+  size_t ovector[2];
+  size_t window = pattern_length_add(finder->maxmatchlen, 1);
+  size_t len = finder->partialmatchlen;
+  size_t outputpos = 0;
+  size_t pos = 1;
+  size_t end;
+  finder->bufferoutput = 1;
+  //the partial match at the start can't complete within the maximum match length (plus one byte for assertions),
+  //so search the rest again in windows limited to twice that length to keep the cost bounded
+  while (pos < len && !*finder->aborted) {
+    end = (len - pos > window && len - pos - window > window ? pos + 2 * window : len);
+    if ((status = search_engine(finder, finder->partialmatch, end, pos, ovector)) >= 0) {
+      //match found within the carried data
+      if (ovector[0] > outputpos)
+        output_data(finder, finder->partialmatch + outputpos, ovector[0] - outputpos);
+      report_match(finder, finder->partialmatch + ovector[0], ovector[1] - ovector[0], finder->partialmatchpos + ovector[0]);
+      outputpos = ovector[1];
+      pos = (ovector[1] > pos ? ovector[1] : pos + 1);
+    } else if (status == PCRE2_ERROR_PARTIAL) {
+      if (end - ovector[0] > window) {
+        //this partial match can't complete either
+        pos = ovector[0] + 1;
+      } else if (end < len) {
+        //nothing starts before the partial match, widen the window from there
+        pos = ovector[0];
+      } else {
+        //keep the remaining partial match (for DFA the last search leaves the workspace ready to restart)
+        if (ovector[0] > outputpos)
+          output_data(finder, finder->partialmatch + outputpos, ovector[0] - outputpos);
+        output_barrier(finder);
+        memmove(finder->partialmatch, finder->partialmatch + ovector[0], len - ovector[0]);
+        finder->partialmatchlen = len - ovector[0];
+        finder->partialmatchsearched = finder->partialmatchlen;
+        finder->partialmatchpos += ovector[0];
+        return;
+      }
+    } else if (status == PCRE2_ERROR_NOMATCH) {
+      pos = end;
+    } else {
+      break;
+    }
+  }
+  //output the remaining data as non-matching data
+  if (len > outputpos)
+    output_data(finder, finder->partialmatch + outputpos, len - outputpos);
+  partialmatch_clear(finder);
+}
+
+static void partialmatch_limit (struct pcre2_finder* finder)
+{
+  //release partial match that exceeds the declared maximum match length (literal partial matches are always shorter)
+  if (finder->maxmatchlen && !finder->literals && finder->partialmatchlen > pattern_length_add(finder->maxmatchlen, 1))
+    partialmatch_release(finder);
+  //give up on partial match that exceeds the maximum size and output it as non-matching data
+  if (finder->maxpartialmatch && finder->partialmatchlen > finder->maxpartialmatch) {
+    finder->bufferoutput = 1;
+    output_data(finder, finder->partialmatch, finder->partialmatchlen);
+    partialmatch_clear(finder);
+  }
+}
+
+static int process_dfa (struct pcre2_finder* finder, const char* data, size_t datalen)
 {
   int status;
   PCRE2_SIZE* ovector;
   PCRE2_SIZE start_offset = 0;
-  //abort if no data was supplied
-  if (datalen == 0)
-    return 0;
   //continue search after previous partial match
-  if (finder->partialmatch) {
-    if ((status = pcre2_dfa_match(finder->re, (PCRE2_UCHAR*)data, datalen, start_offset, PCRE2_OPTIONS | PCRE2_DFA_RESTART, finder->match_data, finder->match_context, finder->dfaworkspace, finder->dfaworkspacesize)) >= 0) {
+  if (finder->partialmatchlen) {
+    finder->bufferoutput = 1;
+    if ((status = dfa_match_restart(finder, data, datalen)) >= 0) {
       //match found in combination with previous partial match
       ovector = pcre2_get_ovector_pointer(finder->match_data);
       partialmatch_append(finder, data + ovector[0], ovector[1] - ovector[0]);
-      (*finder->matchfn)(finder, finder->partialmatch, finder->partialmatchlen, finder->matchcallbackdata, finder->matchid);
+      //the match function may output the match from the buffer, so a barrier is needed before it is reused
+      finder->bufferoutput = 1;
+      report_match(finder, finder->partialmatch, finder->partialmatchlen, finder->partialmatchpos);
       partialmatch_clear(finder);
       start_offset = ovector[1];
     } else if (status == PCRE2_ERROR_PARTIAL) {
       //partial match continues
       ovector = pcre2_get_ovector_pointer(finder->match_data);
       partialmatch_append(finder, data + ovector[0], ovector[1] - ovector[0]);
+      partialmatch_limit(finder);
       return 0;
-    } else if (status == PCRE2_ERROR_NOMATCH) {
+    } else if (status == PCRE2_ERROR_NOMATCH || limit_skip(finder, status)) {
       //no match found in combination with previous partial match
-      (*finder->outputfn)(finder->outputcallbackdata, finder->partialmatch, finder->partialmatchlen);
+      output_data(finder, finder->partialmatch, finder->partialmatchlen);
       partialmatch_clear(finder);
     } else {
       //abort on any other error
@@ -207,24 +1624,29 @@ DLL_EXPORT_PCRE2_FINDER int pcre2_finder_process (struct pcre2_finder* finder, c
     }
   }
   //search data
-  while ((status = pcre2_dfa_match(finder->re, (PCRE2_UCHAR*)data, datalen, start_offset, PCRE2_OPTIONS, finder->match_data, finder->match_context, finder->dfaworkspace, finder->dfaworkspacesize)) >= 0) {
+  while (!*finder->aborted && (status = search_dfa(finder, data, datalen, start_offset)) >= 0) {
     //match found
     ovector = pcre2_get_ovector_pointer(finder->match_data);
     if (ovector[0] > start_offset)
-      (*finder->outputfn)(finder->outputcallbackdata, data + start_offset, ovector[0] - start_offset);
-    (*finder->matchfn)(finder, data + ovector[0], ovector[1] - ovector[0], finder->matchcallbackdata, finder->matchid);
+      output_data(finder, data + start_offset, ovector[0] - start_offset);
+    report_match(finder, data + ovector[0], ovector[1] - ovector[0], finder->inputpos + ovector[0]);
     start_offset = ovector[1];
   }
-  if (status == PCRE2_ERROR_PARTIAL) {
+  if (*finder->aborted) {
+    //a match function asked to stop
+    return PCRE2_FINDER_ABORTED;
+  } else if (status == PCRE2_ERROR_PARTIAL) {
     //keep track of partial match
     ovector = pcre2_get_ovector_pointer(finder->match_data);
     if (ovector[0] > start_offset)
-      (*finder->outputfn)(finder->outputcallbackdata, data + start_offset, ovector[0] - start_offset);
+      output_data(finder, data + start_offset, ovector[0] - start_offset);
+    finder->partialmatchpos = finder->inputpos + ovector[0];
     partialmatch_append(finder, data + ovector[0], ovector[1] - ovector[0]);
-  } else if (status == PCRE2_ERROR_NOMATCH) {
-    //no match found
+    partialmatch_limit(finder);
+  } else if (status == PCRE2_ERROR_NOMATCH || limit_skip(finder, status)) {
+    //no match found (or the rest of the data is skipped after hitting a limit)
     if (datalen > start_offset)
-      (*finder->outputfn)(finder->outputcallbackdata, data + start_offset, datalen - start_offset);
+      output_data(finder, data + start_offset, datalen - start_offset);
   } else {
     //abort on any other error
     return status;
@@ -232,23 +1654,276 @@ DLL_EXPORT_PCRE2_FINDER int pcre2_finder_process (struct pcre2_finder* finder, c
   return 0;
 }
 
-DLL_EXPORT_PCRE2_FINDER int pcre2_finder_close (struct pcre2_finder* finder)
+static int process_search (struct pcre2_finder* finder, const char* data, size_t datalen)
+{
+  int status;
+  size_t ovector[2];
+  size_t start_offset = 0;
+  //continue search after previous partial match
+  if (finder->partialmatchlen) {
+    //searching again from the start of a long partial match for each small block would take quadratic time,
+    //so only append the data until as much new data was added as was searched the last time
+    if (finder->partialmatchlen - finder->partialmatchsearched + datalen < finder->partialmatchsearched && (!finder->maxpartialmatch || finder->partialmatchlen + datalen <= finder->maxpartialmatch)) {
+      if (partialmatch_append(finder, data, datalen) == NULL)
+        return PCRE2_ERROR_NOMEMORY;
+      partialmatch_limit(finder);
+      return 0;
+    }
+  }
+  if (finder->partialmatchlen) {
+    //searching can't resume, so search the carried data followed by (a growing window of) the new data
+    size_t carrylen = finder->partialmatchlen;
+    size_t windowlen = (carrylen < datalen ? carrylen : datalen);
+    size_t pos = 0;
+    output_barrier(finder);
+    finder->bufferoutput = 1;
+    if (carrylen + datalen > finder->matchbufferlen) {
+      if ((finder->matchbuffer = (char*)realloc(finder->matchbuffer, carrylen + datalen)) == NULL) {
+        finder->matchbufferlen = 0;
+        return PCRE2_ERROR_NOMEMORY;
+      }
+      finder->matchbufferlen = carrylen + datalen;
+    }
+    memcpy(finder->matchbuffer, finder->partialmatch, carrylen);
+    memcpy(finder->matchbuffer + carrylen, data, windowlen);
+    while (pos < carrylen && !*finder->aborted) {
+      if ((status = search(finder, finder->matchbuffer, carrylen + windowlen, pos, 0, ovector)) >= 0) {
+        //match found starting in the carried data
+        if (ovector[0] > pos)
+          output_data(finder, finder->matchbuffer + pos, ovector[0] - pos);
+        report_match(finder, finder->matchbuffer + ovector[0], ovector[1] - ovector[0], finder->partialmatchpos + ovector[0]);
+        pos = ovector[1];
+      } else if (status == PCRE2_ERROR_PARTIAL) {
+        if (ovector[0] >= carrylen) {
+          //partial match starts in the new data, so it will be found again there
+          output_data(finder, finder->matchbuffer + pos, carrylen - pos);
+          pos = carrylen;
+        } else if (windowlen < datalen) {
+          //widen the window and try again
+          size_t extra = (windowlen < datalen - windowlen ? windowlen : datalen - windowlen);
+          output_barrier(finder);
+          finder->bufferoutput = 1;
+          memcpy(finder->matchbuffer + carrylen + windowlen, data + windowlen, extra);
+          windowlen += extra;
+        } else {
+          //partial match continues
+          if (ovector[0] > pos)
+            output_data(finder, finder->matchbuffer + pos, ovector[0] - pos);
+          partialmatch_clear(finder);
+          finder->partialmatchpos += ovector[0];
+          partialmatch_append(finder, finder->matchbuffer + ovector[0], carrylen + datalen - ovector[0]);
+          finder->partialmatchsearched = finder->partialmatchlen;
+          partialmatch_limit(finder);
+          return 0;
+        }
+      } else if (status == PCRE2_ERROR_NOMATCH) {
+        //nothing in the window matches
+        output_data(finder, finder->matchbuffer + pos, carrylen + windowlen - pos);
+        pos = carrylen + windowlen;
+      } else if (limit_skip(finder, status)) {
+        //skip the rest of the carried data and search the new data
+        output_data(finder, finder->matchbuffer + pos, carrylen - pos);
+        pos = carrylen;
+      } else {
+        //abort on any other error
+        return status;
+      }
+    }
+    partialmatch_clear(finder);
+    if (*finder->aborted)
+      return PCRE2_FINDER_ABORTED;
+    start_offset = pos - carrylen;
+    if (start_offset >= datalen)
+      return 0;
+  }
+  //search data
+  while (!*finder->aborted && (status = search(finder, data, datalen, start_offset, 0, ovector)) >= 0) {
+    //match found
+    if (ovector[0] > start_offset)
+      output_data(finder, data + start_offset, ovector[0] - start_offset);
+    report_match(finder, data + ovector[0], ovector[1] - ovector[0], finder->inputpos + ovector[0]);
+    start_offset = ovector[1];
+  }
+  if (*finder->aborted) {
+    //a match function asked to stop
+    return PCRE2_FINDER_ABORTED;
+  } else if (status == PCRE2_ERROR_PARTIAL) {
+    //keep track of partial match
+    if (ovector[0] > start_offset)
+      output_data(finder, data + start_offset, ovector[0] - start_offset);
+    finder->partialmatchpos = finder->inputpos + ovector[0];
+    partialmatch_append(finder, data + ovector[0], ovector[1] - ovector[0]);
+    finder->partialmatchsearched = finder->partialmatchlen;
+    partialmatch_limit(finder);
+  } else if (status == PCRE2_ERROR_NOMATCH || limit_skip(finder, status)) {
+    //no match found (or the rest of the data is skipped after hitting a limit)
+    if (datalen > start_offset)
+      output_data(finder, data + start_offset, datalen - start_offset);
+  } else {
+    //abort on any other error
+    return status;
+  }
+  return 0;
+}
+
+static int search_final (struct pcre2_finder* finder, const char* data, size_t datalen, size_t start_offset, size_t* ovector)
+{
+  int status;
+  PCRE2_SIZE* match_ovector;
+  //search without partial matching as no more data follows
+  if (finder->literals || finder->engine != PCRE2_FINDER_ENGINE_DFA)
+    return search(finder, data, datalen, start_offset, 1, ovector);
+  if (finder->useprefilter && (start_offset = prefilter_find(&finder->prefilter, data, datalen, start_offset)) >= datalen)
+    return PCRE2_ERROR_NOMATCH;
+  while ((status = call_dfa_match(finder, data, datalen, start_offset, PCRE2_DFA_SHORTEST | PCRE2_NOTEMPTY)) == PCRE2_ERROR_DFA_WSSIZE) {
+    if (dfa_workspace_grow(finder) != 0)
+      break;
+  }
+  if (status >= 0) {
+    match_ovector = pcre2_get_ovector_pointer(finder->match_data);
+    ovector[0] = match_ovector[0];
+    ovector[1] = match_ovector[1];
+  }
+  return status;
+}
+
+static void flush_partialmatch (struct pcre2_finder* finder)
+{
+  int status;
+  size_t ovector[2];
+  size_t pos = 0;
+  finder->bufferoutput = 1;
+  //matches pending at the end of the data are final now (a greedy match may also end here)
+  while (!*finder->aborted && pos < finder->partialmatchlen && (status = search_final(finder, finder->partialmatch, finder->partialmatchlen, pos, ovector)) >= 0) {
+    if (ovector[0] > pos)
+      output_data(finder, finder->partialmatch + pos, ovector[0] - pos);
+    report_match(finder, finder->partialmatch + ovector[0], ovector[1] - ovector[0], finder->partialmatchpos + ovector[0]);
+    pos = ovector[1];
+  }
+  if (finder->partialmatchlen > pos)
+    output_data(finder, finder->partialmatch + pos, finder->partialmatchlen - pos);
+}
+
+static int process (struct pcre2_finder* finder, const char* data, size_t datalen)
+{
+  int status;
+  //pass on output barrier (see pcre2_finder_output_fn) to the next expression or the output function
+  if (!data && datalen == 0 && finder->outputfn) {
+    (*finder->outputfn)(finder->outputcallbackdata, NULL, 0);
+    return 0;
+  }
+  //abort if no data was supplied
+  if (datalen == 0)
+    return 0;
+  //ignore data after a match function asked to stop
+  if (*finder->aborted)
+    return PCRE2_FINDER_ABORTED;
+  //search using the engine selected for this expression, within its time limit for this data
+  finder->deadline = (finder->timelimit ? get_time_ns() + finder->timelimit : 0);
+  if (finder->literals || finder->engine != PCRE2_FINDER_ENGINE_DFA)
+    status = process_search(finder, data, datalen);
+  else
+    status = process_dfa(finder, data, datalen);
+  finder->deadline = 0;
+  finder->inputpos += datalen;
+  //keep track of data held back for the next call
+  if (finder->collectstats) {
+    finder->stats.bytesin += datalen;
+    if (finder->partialmatchlen) {
+      finder->stats.partialcarries++;
+      if (finder->partialmatchlen > finder->stats.partialpeak)
+        finder->stats.partialpeak = finder->partialmatchlen;
+    }
+  }
+  return status;
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_process (struct pcre2_finder* finder, const char* data, size_t datalen)
+{
+  struct pcre2_finder* current;
+  size_t i;
+  int status = 0;
+  //copy data to the ring buffer of the first worker thread (output barriers aren't needed as the data is copied)
+  //or to that of every worker thread when each expression searches the input
+  if (finder->pipeline) {
+    if (!data || !datalen)
+      return 0;
+    if (!finder->independent)
+      return pipeline_write(finder->pipeline, 0, data, datalen);
+    for (i = 0; finder->stages[i].last->next; i++) {
+      if ((status = pipeline_write(finder->pipeline, i, data, datalen)) != 0)
+        return status;
+    }
+    return pipeline_write(finder->pipeline, i, data, datalen);
+  }
+  //search the data with each expression instead of passing the output of each expression to the next
+  if (finder->independent && data && datalen) {
+    for (current = finder; current; current = current->next) {
+      if ((status = process(current, data, datalen)) != 0)
+        break;
+    }
+  } else {
+    status = process(finder, data, datalen);
+  }
+  //deliver the matches in this data while it is still valid (only the first node is called from outside)
+  if (finder->batch && finder->batch->finder == finder)
+    batch_deliver(finder->batch);
+  //report a stop requested by a match function anywhere in the chain
+  return (status >= 0 && *finder->aborted ? PCRE2_FINDER_ABORTED : status);
+}
+
+static void close_nodes (struct pcre2_finder* finder, struct pcre2_finder* end)
 {
   struct pcre2_finder* current = finder;
-  while (current) {
-    if (current->partialmatch) {
-      (*current->outputfn)(current->outputcallbackdata, current->partialmatch, current->partialmatchlen);
-      free(current->partialmatch);
-      current->partialmatch = NULL;
-      current->partialmatchlen = 0;
+  while (current != end) {
+    //matches at the end of the data aren't reported after a match function asked to stop
+    if (current->partialmatchlen && !*current->aborted) {
+      flush_partialmatch(current);
+      partialmatch_clear(current);
+      current->bufferoutput = 1;
     }
     current = current->next;
   }
-  return 0;
+}
+
+static int stage_process (void* stagedata, const char* data, size_t datalen)
+{
+  struct pcre2_finder_stage* stage = (struct pcre2_finder_stage*)stagedata;
+  int status;
+  //output partial matches of this group at the end of the data
+  if (!data) {
+    close_nodes(stage->first, stage->last->next);
+    return 0;
+  }
+  //each expression in the group searches the same data
+  if (stage->first->independent) {
+    struct pcre2_finder* current;
+    for (current = stage->first; current != stage->last->next; current = current->next) {
+      if ((status = process(current, data, datalen)) != 0)
+        return status;
+    }
+    return 0;
+  }
+  status = process(stage->first, data, datalen);
+  //tell the output function that the data in the ring buffer is about to be overwritten
+  (*stage->last->outputfn)(stage->last->outputcallbackdata, NULL, 0);
+  //stopping the pipeline makes the other groups skip the remaining data
+  return (status < 0 ? status : stage->aborted ? PCRE2_FINDER_ABORTED : 0);
+}
+
+DLL_EXPORT_PCRE2_FINDER int pcre2_finder_close (struct pcre2_finder* finder)
+{
+  //drain the data through the worker threads, which output the partial matches of their own expressions
+  if (finder->pipeline)
+    return stop_threads(finder);
+  close_nodes(finder, NULL);
+  if (finder->batch)
+    batch_deliver(finder->batch);
+  return (*finder->aborted ? PCRE2_FINDER_ABORTED : 0);
 }
 
 DLL_EXPORT_PCRE2_FINDER size_t pcre2_finder_output (struct pcre2_finder* finder, const char* data, size_t datalen)
 {
-  return (*finder->outputfn)(finder->outputcallbackdata, data, datalen);
+  return output_data(finder, data, datalen);
 }
 
@@ -0,0 +1,357 @@
+#include "pipeline.h"
+#include <string.h>
+
+#ifdef PCRE2_FINDER_THREADS
+
+#include <pthread.h>
+
+//ring buffer entry, followed by the data unless it was too large and was allocated separately
+struct pipeline_record {
+  size_t len;
+  char* data;
+};
+
+//length of entry marking the rest of the ring buffer as unused
+#define PIPELINE_RECORD_SKIP ((size_t)-1)
+
+struct pipeline_ring {
+  char* buffer;
+  size_t size;
+  size_t head;          //total number of bytes consumed (only written by the consumer)
+  size_t tail;          //total number of bytes produced (only written by the producer)
+  int closed;
+  int producerwaiting;
+  int consumerwaiting;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+struct pipeline_stage {
+  struct pipeline_struct* pipeline;
+  size_t index;
+  pipeline_stage_fn stagefn;
+  void* stagedata;
+  struct pipeline_ring ring;
+  pthread_t thread;
+  int started;
+};
+
+struct pipeline_struct {
+  size_t stagecount;
+  struct pipeline_stage* stages;
+  int status;
+  int finished;
+};
+
+static size_t record_size (const struct pipeline_record* record)
+{
+  //entries are aligned to the entry header size
+  if (record->data)
+    return sizeof(struct pipeline_record);
+  return sizeof(struct pipeline_record) + (record->len + sizeof(struct pipeline_record) - 1) / sizeof(struct pipeline_record) * sizeof(struct pipeline_record);
+}
+
+static int ring_initialize (struct pipeline_ring* ring, size_t size)
+{
+  if ((ring->buffer = (char*)malloc(size)) == NULL)
+    return -1;
+  ring->size = size;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->closed = 0;
+  ring->producerwaiting = 0;
+  ring->consumerwaiting = 0;
+  pthread_mutex_init(&ring->mutex, NULL);
+  pthread_cond_init(&ring->cond, NULL);
+  return 0;
+}
+
+static void ring_cleanup (struct pipeline_ring* ring)
+{
+  struct pipeline_record* record;
+  //free separately allocated data that was never consumed
+  while (ring->head != ring->tail) {
+    record = (struct pipeline_record*)(ring->buffer + (ring->head & (ring->size - 1)));
+    if (record->len == PIPELINE_RECORD_SKIP) {
+      ring->head += ring->size - (ring->head & (ring->size - 1));
+    } else {
+      if (record->data)
+        free(record->data);
+      ring->head += record_size(record);
+    }
+  }
+  pthread_cond_destroy(&ring->cond);
+  pthread_mutex_destroy(&ring->mutex);
+  free(ring->buffer);
+}
+
+static void ring_wake (struct pipeline_ring* ring, int* waiting)
+{
+  //only take the lock if the other side is (about to start) waiting
+  if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&ring->mutex);
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->mutex);
+  }
+}
+
+static void ring_wait_for_space (struct pipeline_ring* ring, size_t len)
+{
+  pthread_mutex_lock(&ring->mutex);
+  __atomic_store_n(&ring->producerwaiting, 1, __ATOMIC_SEQ_CST);
+  while (ring->size - (ring->tail - __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST)) < len)
+    pthread_cond_wait(&ring->cond, &ring->mutex);
+  __atomic_store_n(&ring->producerwaiting, 0, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&ring->mutex);
+}
+
+static void ring_wait_for_data (struct pipeline_ring* ring)
+{
+  pthread_mutex_lock(&ring->mutex);
+  __atomic_store_n(&ring->consumerwaiting, 1, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == ring->head && !__atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST))
+    pthread_cond_wait(&ring->cond, &ring->mutex);
+  __atomic_store_n(&ring->consumerwaiting, 0, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&ring->mutex);
+}
+
+static void ring_reserve (struct pipeline_ring* ring, size_t len)
+{
+  //wait while the ring buffer is full (backpressure)
+  if (ring->size - (ring->tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) < len)
+    ring_wait_for_space(ring, len);
+}
+
+static int ring_write (struct pipeline_ring* ring, const char* data, size_t datalen)
+{
+  struct pipeline_record* record;
+  struct pipeline_record entry;
+  size_t offset;
+  size_t contiguous;
+  size_t len;
+  //large data is allocated separately to keep room for other entries
+  entry.len = datalen;
+  entry.data = NULL;
+  if ((len = record_size(&entry)) > ring->size / 4) {
+    if ((entry.data = (char*)malloc(datalen)) == NULL)
+      return -1;
+    memcpy(entry.data, data, datalen);
+    len = record_size(&entry);
+  }
+  //entries don't wrap around, so mark the rest of the buffer as unused if the entry doesn't fit
+  offset = ring->tail & (ring->size - 1);
+  contiguous = ring->size - offset;
+  if (len > contiguous) {
+    ring_reserve(ring, contiguous);
+    ((struct pipeline_record*)(ring->buffer + offset))->len = PIPELINE_RECORD_SKIP;
+    __atomic_store_n(&ring->tail, ring->tail + contiguous, __ATOMIC_SEQ_CST);
+    offset = 0;
+  }
+  ring_reserve(ring, len);
+  record = (struct pipeline_record*)(ring->buffer + offset);
+  *record = entry;
+  if (!entry.data)
+    memcpy(record + 1, data, datalen);
+  __atomic_store_n(&ring->tail, ring->tail + len, __ATOMIC_SEQ_CST);
+  ring_wake(ring, &ring->consumerwaiting);
+  return 0;
+}
+
+static int ring_read (struct pipeline_ring* ring, const char** data, size_t* datalen)
+{
+  struct pipeline_record* record;
+  size_t offset;
+  while (1) {
+    //wait for data, return non-zero when the producer is done
+    while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == ring->head) {
+      if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) && __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == ring->head)
+        return -1;
+      ring_wait_for_data(ring);
+    }
+    offset = ring->head & (ring->size - 1);
+    record = (struct pipeline_record*)(ring->buffer + offset);
+    if (record->len != PIPELINE_RECORD_SKIP)
+      break;
+    //skip unused space at the end of the buffer
+    __atomic_store_n(&ring->head, ring->head + ring->size - offset, __ATOMIC_SEQ_CST);
+    ring_wake(ring, &ring->producerwaiting);
+  }
+  *data = (record->data ? record->data : (const char*)(record + 1));
+  *datalen = record->len;
+  return 0;
+}
+
+static void ring_consume (struct pipeline_ring* ring)
+{
+  struct pipeline_record* record = (struct pipeline_record*)(ring->buffer + (ring->head & (ring->size - 1)));
+  size_t len = record_size(record);
+  if (record->data)
+    free(record->data);
+  __atomic_store_n(&ring->head, ring->head + len, __ATOMIC_SEQ_CST);
+  ring_wake(ring, &ring->producerwaiting);
+}
+
+static void ring_close (struct pipeline_ring* ring)
+{
+  __atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
+  ring_wake(ring, &ring->consumerwaiting);
+}
+
+static void set_status (struct pipeline_struct* pipeline, int status)
+{
+  int expected = 0;
+  if (status != 0)
+    __atomic_compare_exchange_n(&pipeline->status, &expected, status, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static void* stage_thread (void* arg)
+{
+  struct pipeline_stage* stage = (struct pipeline_stage*)arg;
+  const char* data;
+  size_t datalen;
+  //process data until the previous stage is done, after an error data is only consumed to avoid blocking the producer
+  while (ring_read(&stage->ring, &data, &datalen) == 0) {
+    if (__atomic_load_n(&stage->pipeline->status, __ATOMIC_ACQUIRE) == 0)
+      set_status(stage->pipeline, (*stage->stagefn)(stage->stagedata, data, datalen));
+    ring_consume(&stage->ring);
+  }
+  set_status(stage->pipeline, (*stage->stagefn)(stage->stagedata, NULL, 0));
+  //signal the end of the data to the next stage
+  if (stage->index + 1 < stage->pipeline->stagecount)
+    ring_close(&stage->pipeline->stages[stage->index + 1].ring);
+  return NULL;
+}
+
+int pipeline_available ()
+{
+  return 1;
+}
+
+struct pipeline_struct* pipeline_create (size_t stagecount, size_t ringsize)
+{
+  struct pipeline_struct* pipeline;
+  size_t i;
+  if (stagecount == 0 || ringsize < 4 * sizeof(struct pipeline_record) || (ringsize & (ringsize - 1)) != 0)
+    return NULL;
+  if ((pipeline = (struct pipeline_struct*)malloc(sizeof(struct pipeline_struct))) == NULL)
+    return NULL;
+  if ((pipeline->stages = (struct pipeline_stage*)malloc(stagecount * sizeof(struct pipeline_stage))) == NULL) {
+    free(pipeline);
+    return NULL;
+  }
+  pipeline->stagecount = stagecount;
+  pipeline->status = 0;
+  pipeline->finished = 0;
+  for (i = 0; i < stagecount; i++) {
+    pipeline->stages[i].pipeline = pipeline;
+    pipeline->stages[i].index = i;
+    pipeline->stages[i].stagefn = NULL;
+    pipeline->stages[i].stagedata = NULL;
+    pipeline->stages[i].started = 0;
+    if (ring_initialize(&pipeline->stages[i].ring, ringsize) != 0) {
+      while (i-- > 0)
+        ring_cleanup(&pipeline->stages[i].ring);
+      free(pipeline->stages);
+      free(pipeline);
+      return NULL;
+    }
+  }
+  return pipeline;
+}
+
+void pipeline_set_stage (struct pipeline_struct* pipeline, size_t index, pipeline_stage_fn stagefn, void* stagedata)
+{
+  pipeline->stages[index].stagefn = stagefn;
+  pipeline->stages[index].stagedata = stagedata;
+}
+
+int pipeline_start (struct pipeline_struct* pipeline)
+{
+  size_t i;
+  for (i = 0; i < pipeline->stagecount; i++) {
+    if (pthread_create(&pipeline->stages[i].thread, NULL, stage_thread, &pipeline->stages[i]) != 0) {
+      //let the threads that were started finish
+      set_status(pipeline, -1);
+      ring_close(&pipeline->stages[i].ring);
+      pipeline_finish(pipeline);
+      return -1;
+    }
+    pipeline->stages[i].started = 1;
+  }
+  return 0;
+}
+
+int pipeline_write (struct pipeline_struct* pipeline, size_t index, const char* data, size_t datalen)
+{
+  if (ring_write(&pipeline->stages[index].ring, data, datalen) != 0)
+    set_status(pipeline, -1);
+  return __atomic_load_n(&pipeline->status, __ATOMIC_ACQUIRE);
+}
+
+int pipeline_finish (struct pipeline_struct* pipeline)
+{
+  size_t i;
+  if (!pipeline->finished) {
+    //end of data propagates through the stages as each one finishes
+    ring_close(&pipeline->stages[0].ring);
+    for (i = 0; i < pipeline->stagecount; i++) {
+      if (pipeline->stages[i].started) {
+        pthread_join(pipeline->stages[i].thread, NULL);
+        pipeline->stages[i].started = 0;
+      } else {
+        ring_close(&pipeline->stages[i].ring);
+      }
+    }
+    pipeline->finished = 1;
+  }
+  return pipeline->status;
+}
+
+void pipeline_cleanup (struct pipeline_struct* pipeline)
+{
+  size_t i;
+  if (!pipeline)
+    return;
+  pipeline_finish(pipeline);
+  for (i = 0; i < pipeline->stagecount; i++)
+    ring_cleanup(&pipeline->stages[i].ring);
+  free(pipeline->stages);
+  free(pipeline);
+}
+
+#else
+
+int pipeline_available ()
+{
+  return 0;
+}
+
+struct pipeline_struct* pipeline_create (size_t stagecount, size_t ringsize)
+{
+  return NULL;
+}
+
+void pipeline_set_stage (struct pipeline_struct* pipeline, size_t index, pipeline_stage_fn stagefn, void* stagedata)
+{
+}
+
+int pipeline_start (struct pipeline_struct* pipeline)
+{
+  return -1;
+}
+
+int pipeline_write (struct pipeline_struct* pipeline, size_t index, const char* data, size_t datalen)
+{
+  return -1;
+}
+
+int pipeline_finish (struct pipeline_struct* pipeline)
+{
+  return -1;
+}
+
+void pipeline_cleanup (struct pipeline_struct* pipeline)
+{
+}
+
+#endif
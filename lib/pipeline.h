@@ -0,0 +1,46 @@
+#ifndef INCLUDED_PIPELINE_H
+#define INCLUDED_PIPELINE_H
+
+#include <stdlib.h>
+
+/* C library for running processing stages on worker threads connected by single-producer/single-consumer ring buffers */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//default size of the ring buffer feeding each stage (must be a power of 2)
+#define PIPELINE_RING_SIZE (1024 * 1024)
+
+//function called by a stage's worker thread once for each pipeline_write() to the stage (data is NULL and datalen 0 at the end of the data)
+typedef int (*pipeline_stage_fn) (void* stagedata, const char* data, size_t datalen);
+
+//pipeline object
+struct pipeline_struct;
+
+//check if pipelines are supported (built with PCRE2_FINDER_THREADS), returns non-zero if supported
+int pipeline_available ();
+
+//create pipeline with the specified number of stages and ring buffer size, returns NULL on error
+struct pipeline_struct* pipeline_create (size_t stagecount, size_t ringsize);
+
+//set function and data for a stage (before pipeline_start())
+void pipeline_set_stage (struct pipeline_struct* pipeline, size_t index, pipeline_stage_fn stagefn, void* stagedata);
+
+//start worker threads, returns zero on success
+int pipeline_start (struct pipeline_struct* pipeline);
+
+//copy data to a stage (blocks while its ring buffer is full), returns zero on success or the first error returned by a stage
+int pipeline_write (struct pipeline_struct* pipeline, size_t index, const char* data, size_t datalen);
+
+//signal the end of the data and wait until all stages are done, returns zero on success or the first error returned by a stage
+int pipeline_finish (struct pipeline_struct* pipeline);
+
+//clean up pipeline (calls pipeline_finish() if needed)
+void pipeline_cleanup (struct pipeline_struct* pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_PIPELINE_H
@@ -0,0 +1,152 @@
+#include "prefilter.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PREFILTER_X86
+#include <immintrin.h>
+#endif
+
+static void select_implementation ();
+
+int prefilter_initialize (struct prefilter_struct* prefilter, const pcre2_code* re)
+{
+  uint32_t options;
+  uint32_t minlength;
+  uint32_t firstcodetype;
+  uint32_t firstcodeunit;
+  const uint8_t* bitmap;
+  int i;
+  prefilter->bytecount = 0;
+  prefilter->usebitmap = 0;
+  select_implementation();
+  if (pcre2_pattern_info(re, PCRE2_INFO_ALLOPTIONS, &options) != 0 || pcre2_pattern_info(re, PCRE2_INFO_MINLENGTH, &minlength) != 0 || pcre2_pattern_info(re, PCRE2_INFO_FIRSTCODETYPE, &firstcodetype) != 0)
+    return 0;
+  //skipping is not possible for anchored patterns or patterns that can match an empty string
+  if ((options & PCRE2_ANCHORED) || minlength == 0)
+    return 0;
+  if (firstcodetype == 1) {
+    //fixed first code unit (also look for the other case as caseless matching is not reported)
+    if (pcre2_pattern_info(re, PCRE2_INFO_FIRSTCODEUNIT, &firstcodeunit) != 0 || firstcodeunit > 0xFF)
+      return 0;
+    //in UTF mode a caseless character may start with a different byte
+    if (firstcodeunit >= 0x80 && (options & PCRE2_UTF))
+      return 0;
+    prefilter->bytes[prefilter->bytecount++] = (unsigned char)firstcodeunit;
+    if (firstcodeunit >= 'a' && firstcodeunit <= 'z')
+      prefilter->bytes[prefilter->bytecount++] = (unsigned char)(firstcodeunit - 'a' + 'A');
+    else if (firstcodeunit >= 'A' && firstcodeunit <= 'Z')
+      prefilter->bytes[prefilter->bytecount++] = (unsigned char)(firstcodeunit - 'A' + 'a');
+    return 1;
+  }
+  if (firstcodetype == 0 && pcre2_pattern_info(re, PCRE2_INFO_FIRSTBITMAP, &bitmap) == 0 && bitmap) {
+    //set of possible first code units
+    memcpy(prefilter->bitmap, bitmap, 32);
+    for (i = 0; i < 256; i++) {
+      if (bitmap[i >> 3] & (1 << (i & 7))) {
+        if (prefilter->bytecount >= PREFILTER_MAX_BYTES) {
+          prefilter->bytecount = 0;
+          prefilter->usebitmap = 1;
+          return 1;
+        }
+        prefilter->bytes[prefilter->bytecount++] = (unsigned char)i;
+      }
+    }
+    return (prefilter->bytecount > 0);
+  }
+  return 0;
+}
+
+static size_t find_bytes_scalar (const unsigned char* bytes, int bytecount, const char* data, size_t datalen, size_t pos)
+{
+  int i;
+  while (pos < datalen) {
+    for (i = 0; i < bytecount; i++)
+      if ((unsigned char)data[pos] == bytes[i])
+        return pos;
+    pos++;
+  }
+  return datalen;
+}
+
+#ifdef PREFILTER_X86
+__attribute__((target("sse2")))
+static size_t find_bytes_sse2 (const unsigned char* bytes, int bytecount, const char* data, size_t datalen, size_t pos)
+{
+  __m128i v0 = _mm_set1_epi8((char)bytes[0]);
+  __m128i v1 = _mm_set1_epi8((char)bytes[bytecount > 1 ? 1 : 0]);
+  __m128i v2 = _mm_set1_epi8((char)bytes[bytecount > 2 ? 2 : 0]);
+  __m128i v3 = _mm_set1_epi8((char)bytes[bytecount > 3 ? 3 : 0]);
+  __m128i d;
+  int mask;
+  while (pos + 16 <= datalen) {
+    d = _mm_loadu_si128((const __m128i*)(data + pos));
+    mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(d, v0), _mm_cmpeq_epi8(d, v1)), _mm_or_si128(_mm_cmpeq_epi8(d, v2), _mm_cmpeq_epi8(d, v3))));
+    if (mask)
+      return pos + __builtin_ctz(mask);
+    pos += 16;
+  }
+  return find_bytes_scalar(bytes, bytecount, data, datalen, pos);
+}
+
+__attribute__((target("avx2")))
+static size_t find_bytes_avx2 (const unsigned char* bytes, int bytecount, const char* data, size_t datalen, size_t pos)
+{
+  __m256i v0 = _mm256_set1_epi8((char)bytes[0]);
+  __m256i v1 = _mm256_set1_epi8((char)bytes[bytecount > 1 ? 1 : 0]);
+  __m256i v2 = _mm256_set1_epi8((char)bytes[bytecount > 2 ? 2 : 0]);
+  __m256i v3 = _mm256_set1_epi8((char)bytes[bytecount > 3 ? 3 : 0]);
+  __m256i d;
+  unsigned int mask;
+  while (pos + 32 <= datalen) {
+    d = _mm256_loadu_si256((const __m256i*)(data + pos));
+    mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(d, v0), _mm256_cmpeq_epi8(d, v1)), _mm256_or_si256(_mm256_cmpeq_epi8(d, v2), _mm256_cmpeq_epi8(d, v3))));
+    if (mask)
+      return pos + __builtin_ctz(mask);
+    pos += 32;
+  }
+  return find_bytes_scalar(bytes, bytecount, data, datalen, pos);
+}
+#endif
+
+typedef size_t (*find_bytes_fn) (const unsigned char* bytes, int bytecount, const char* data, size_t datalen, size_t pos);
+
+static find_bytes_fn find_bytes = NULL;
+
+static find_bytes_fn select_find_bytes ()
+{
+#ifdef PREFILTER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return &find_bytes_avx2;
+  if (__builtin_cpu_supports("sse2"))
+    return &find_bytes_sse2;
+#endif
+  return &find_bytes_scalar;
+}
+
+static void select_implementation ()
+{
+  //pick the best implementation for this CPU the first time (while initializing, before searching on other threads)
+  if (!find_bytes)
+    find_bytes = select_find_bytes();
+}
+
+size_t prefilter_find (const struct prefilter_struct* prefilter, const char* data, size_t datalen, size_t pos)
+{
+  const char* p;
+  if (pos >= datalen)
+    return datalen;
+  if (prefilter->usebitmap) {
+    while (pos < datalen && !(prefilter->bitmap[(unsigned char)data[pos] >> 3] & (1 << ((unsigned char)data[pos] & 7))))
+      pos++;
+    return pos;
+  }
+  if (prefilter->bytecount == 1) {
+    if ((p = (const char*)memchr(data + pos, prefilter->bytes[0], datalen - pos)) == NULL)
+      return datalen;
+    return p - data;
+  }
+  if (prefilter->bytecount == 0)
+    return pos;
+  return (*find_bytes)(prefilter->bytes, prefilter->bytecount, data, datalen, pos);
+}
@@ -0,0 +1,33 @@
+#ifndef INCLUDED_PREFILTER_H
+#define INCLUDED_PREFILTER_H
+
+#include "pcre2_finder.h"
+
+/* C library for skipping to candidate match positions before invoking PCRE2 */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//maximum number of candidate bytes compared using vector instructions
+#define PREFILTER_MAX_BYTES 4
+
+//data structure
+struct prefilter_struct {
+  int bytecount;
+  unsigned char bytes[PREFILTER_MAX_BYTES];
+  int usebitmap;
+  unsigned char bitmap[32];
+};
+
+//initialize from compiled pattern (returns non-zero if a prefilter can be used)
+int prefilter_initialize (struct prefilter_struct* prefilter, const pcre2_code* re);
+
+//get offset of first candidate match position at or after pos (returns datalen if none found)
+size_t prefilter_find (const struct prefilter_struct* prefilter, const char* data, size_t datalen, size_t pos);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_PREFILTER_H
@@ -2,11 +2,30 @@
 #include <stdlib.h>
 #include <string.h>
 
+//smallest ring size (must be a power of 2)
+#define SEARCH_DATA_BUFFER_MIN_ALLOC 4096
+
+//size of the blocks in which data spilled to disk is read back when flushing
+#define SEARCH_DATA_BUFFER_READ_BLOCK (64 * 1024)
+
+#ifdef _WIN32
+#define spill_seek(f, offset) _fseeki64(f, (__int64)(offset), SEEK_SET)
+#else
+#define spill_seek(f, offset) fseeko(f, (off_t)(offset), SEEK_SET)
+#endif
+
 struct search_data_buffer_struct {
   char* data;
   size_t datalen;
   size_t dataalloclen;
+  size_t datastart;
   size_t diskpos;
+  size_t maxmemory;
+  FILE* spillfile;
+  unsigned long long spillstart;
+  size_t spilllen;
+  char* readbuffer;
+  size_t readbufferlen;
 };
 
 struct search_data_buffer_struct* initialize_search_data_buffer ()
@@ -16,7 +35,14 @@ struct search_data_buffer_struct* initialize_search_data_buffer ()
     result->data = NULL;
     result->datalen = 0;
     result->dataalloclen = 0;
+    result->datastart = 0;
     result->diskpos = 0;
+    result->maxmemory = 0;
+    result->spillfile = NULL;
+    result->spillstart = 0;
+    result->spilllen = 0;
+    result->readbuffer = NULL;
+    result->readbufferlen = 0;
   }
   return result;
 };
@@ -26,84 +52,238 @@ void deinitialize_search_data_buffer (struct search_data_buffer_struct* searchda
   if (searchdata) {
     if (searchdata->data)
       free(searchdata->data);
+    if (searchdata->spillfile)
+      fclose(searchdata->spillfile);
+    free(searchdata->readbuffer);
     free(searchdata);
   }
 };
 
 void reset_search_data_buffer (struct search_data_buffer_struct* searchdata)
 {
-  if (searchdata->data)
-    free(searchdata->data);
-  searchdata->data = NULL;
+  //keep the allocated ring and temporary file for reuse
   searchdata->datalen = 0;
-  searchdata->dataalloclen = 0;
+  searchdata->datastart = 0;
   searchdata->diskpos = 0;
+  searchdata->spillstart = 0;
+  searchdata->spilllen = 0;
+}
+
+void search_data_buffer_set_max_memory (struct search_data_buffer_struct* searchdata, size_t maxmemory)
+{
+  searchdata->maxmemory = maxmemory;
+}
+
+size_t search_data_buffer_get_spilled (struct search_data_buffer_struct* searchdata)
+{
+  return searchdata->spilllen;
+}
+
+static size_t get_views (struct search_data_buffer_struct* searchdata, size_t offset, size_t len, const char** data1, size_t* len1, const char** data2, size_t* len2)
+{
+  //get the (up to 2) segments holding len bytes starting offset bytes after the start of the buffered data
+  size_t start = (searchdata->datastart + offset) & (searchdata->dataalloclen - 1);
+  if (len == 0) {
+    *data1 = NULL;
+    *len1 = 0;
+  } else {
+    *data1 = searchdata->data + start;
+    *len1 = (len < searchdata->dataalloclen - start ? len : searchdata->dataalloclen - start);
+  }
+  *data2 = (len > *len1 ? searchdata->data : NULL);
+  *len2 = len - *len1;
+  return len;
+}
+
+static int set_alloc (struct search_data_buffer_struct* searchdata, size_t alloclen)
+{
+  char* newdata;
+  const char* data1;
+  const char* data2;
+  size_t len1;
+  size_t len2;
+  //move the buffered data to the start of a new ring
+  if ((newdata = (char*)malloc(alloclen)) == NULL)
+    return -1;
+  if (searchdata->data) {
+    get_views(searchdata, 0, searchdata->datalen, &data1, &len1, &data2, &len2);
+    if (len1)
+      memcpy(newdata, data1, len1);
+    if (len2)
+      memcpy(newdata + len1, data2, len2);
+    free(searchdata->data);
+  }
+  searchdata->data = newdata;
+  searchdata->dataalloclen = alloclen;
+  searchdata->datastart = 0;
+  return 0;
+}
+
+static void consume (struct search_data_buffer_struct* searchdata, size_t len)
+{
+  searchdata->datalen -= len;
+  searchdata->datastart = (searchdata->datalen ? (searchdata->datastart + len) & (searchdata->dataalloclen - 1) : 0);
+}
+
+static int spill_write (struct search_data_buffer_struct* searchdata, const char* data, size_t datalen)
+{
+  //append to the (unlinked) temporary file after the data spilled before
+  if (!searchdata->spillfile && (searchdata->spillfile = tmpfile()) == NULL)
+    return -1;
+  if (spill_seek(searchdata->spillfile, searchdata->spillstart + searchdata->spilllen) != 0 || fwrite(data, 1, datalen, searchdata->spillfile) != datalen)
+    return -1;
+  searchdata->spilllen += datalen;
+  return 0;
+}
+
+static int spill_read (struct search_data_buffer_struct* searchdata, size_t offset, size_t len, char* dst)
+{
+  //read len bytes starting offset bytes after the start of the data spilled to disk
+  if (spill_seek(searchdata->spillfile, searchdata->spillstart + offset) != 0 || fread(dst, 1, len, searchdata->spillfile) != len)
+    return -1;
+  return 0;
+}
+
+static char* get_read_buffer (struct search_data_buffer_struct* searchdata, size_t len)
+{
+  char* newbuffer;
+  if (len > searchdata->readbufferlen) {
+    if ((newbuffer = (char*)realloc(searchdata->readbuffer, len)) == NULL)
+      return NULL;
+    searchdata->readbuffer = newbuffer;
+    searchdata->readbufferlen = len;
+  }
+  return searchdata->readbuffer;
+}
+
+static void spill (struct search_data_buffer_struct* searchdata, const char** data, size_t* datalen)
+{
+  const char* data1;
+  const char* data2;
+  size_t len1;
+  size_t len2;
+  size_t len = searchdata->datalen + *datalen - searchdata->maxmemory;
+  //move the oldest data in memory to disk first, then the start of the new data if that doesn't fit either
+  //(if writing fails the data is kept in memory)
+  if (searchdata->datalen) {
+    get_views(searchdata, 0, (len < searchdata->datalen ? len : searchdata->datalen), &data1, &len1, &data2, &len2);
+    if (spill_write(searchdata, data1, len1) != 0)
+      return;
+    consume(searchdata, len1);
+    len -= len1;
+    if (len2) {
+      if (spill_write(searchdata, data2, len2) != 0)
+        return;
+      consume(searchdata, len2);
+      len -= len2;
+    }
+  }
+  if (len && spill_write(searchdata, *data, len) == 0) {
+    *data += len;
+    *datalen -= len;
+  }
 }
 
 void search_data_buffer_add (struct search_data_buffer_struct* searchdata, const char* data, size_t datalen)
 {
+  char* data1;
+  size_t len1;
+  size_t end;
+  //keep memory use within the maximum by spilling data to disk
+  if (searchdata->maxmemory && searchdata->datalen + datalen > searchdata->maxmemory)
+    spill(searchdata, &data, &datalen);
+  //grow ring to the next power of 2 that fits
   if (searchdata->datalen + datalen > searchdata->dataalloclen) {
-    searchdata->dataalloclen = searchdata->datalen + datalen;
-    searchdata->data = (char*)realloc(searchdata->data, searchdata->dataalloclen);
+    size_t newalloc = (searchdata->dataalloclen ? searchdata->dataalloclen : SEARCH_DATA_BUFFER_MIN_ALLOC);
+    while (newalloc < searchdata->datalen + datalen)
+      newalloc *= 2;
+    if (set_alloc(searchdata, newalloc) != 0)
+      return;
   }
-  memcpy(searchdata->data + searchdata->datalen, data, datalen);
+  if (datalen == 0)
+    return;
+  //copy in up to 2 parts when wrapping around the end of the ring
+  end = (searchdata->datastart + searchdata->datalen) & (searchdata->dataalloclen - 1);
+  data1 = searchdata->data + end;
+  len1 = (datalen < searchdata->dataalloclen - end ? datalen : searchdata->dataalloclen - end);
+  memcpy(data1, data, len1);
+  if (datalen > len1)
+    memcpy(searchdata->data, data + len1, datalen - len1);
   searchdata->datalen += datalen;
 }
 
+static size_t write_file (void* callbackdata, const char* data, size_t datalen)
+{
+  return fwrite(data, 1, datalen, (FILE*)callbackdata);
+}
+
 size_t search_data_buffer_flush (struct search_data_buffer_struct* searchdata, size_t flushpos, FILE* dst)
 {
-  size_t result;
-  if (flushpos <= searchdata->diskpos)
-    return 0;
-  if (flushpos > searchdata->diskpos + searchdata->datalen)
-    flushpos = searchdata->diskpos + searchdata->datalen;
-  if (dst)
-    result = fwrite(searchdata->data, 1, flushpos - searchdata->diskpos, dst);
-  else
-    result = flushpos - searchdata->diskpos;
-  memmove(searchdata->data, searchdata->data + flushpos - searchdata->diskpos, searchdata->datalen -= flushpos - searchdata->diskpos);
-  searchdata->diskpos = flushpos;
-  return result;
+  return search_data_buffer_flush_fn(searchdata, flushpos, (dst ? write_file : NULL), dst);
 }
 
 size_t search_data_buffer_flush_fn (struct search_data_buffer_struct* searchdata, size_t flushpos, search_data_buffer_output_fn flushfn, void* callbackdata)
 {
-  size_t result;
+  const char* data1;
+  const char* data2;
+  size_t len1;
+  size_t len2;
+  size_t len;
+  size_t written;
+  size_t result = 0;
+  int failed = 0;
   if (flushpos <= searchdata->diskpos)
     return 0;
-  if (flushpos > searchdata->diskpos + searchdata->datalen)
-    flushpos = searchdata->diskpos + searchdata->datalen;
-  if (flushfn)
-    result = (*flushfn)(callbackdata, searchdata->data, flushpos - searchdata->diskpos);
-  else
-    result = flushpos - searchdata->diskpos;
-  memmove(searchdata->data, searchdata->data + flushpos - searchdata->diskpos, searchdata->datalen -= flushpos - searchdata->diskpos);
+  if (flushpos > searchdata->diskpos + searchdata->spilllen + searchdata->datalen)
+    flushpos = searchdata->diskpos + searchdata->spilllen + searchdata->datalen;
+  //flush data spilled to disk first, reading it back in blocks
+  while (searchdata->spilllen && flushpos > searchdata->diskpos) {
+    len = flushpos - searchdata->diskpos;
+    if (len > searchdata->spilllen)
+      len = searchdata->spilllen;
+    if (flushfn && !failed) {
+      if (len > SEARCH_DATA_BUFFER_READ_BLOCK)
+        len = SEARCH_DATA_BUFFER_READ_BLOCK;
+      //stop without discarding the data if it can't be read back
+      if (get_read_buffer(searchdata, len) == NULL || spill_read(searchdata, 0, len, searchdata->readbuffer) != 0)
+        return result;
+      if ((written = (*flushfn)(callbackdata, searchdata->readbuffer, len)) != len)
+        failed = 1;
+      result += written;
+    } else if (!flushfn) {
+      result += len;
+    }
+    searchdata->spillstart += len;
+    searchdata->spilllen -= len;
+    searchdata->diskpos += len;
+    if (!searchdata->spilllen)
+      searchdata->spillstart = 0;
+  }
+  if (flushpos <= searchdata->diskpos)
+    return result;
+  //flush data in memory
+  len = get_views(searchdata, 0, flushpos - searchdata->diskpos, &data1, &len1, &data2, &len2);
+  if (!flushfn) {
+    result += len;
+  } else if (!failed) {
+    len = (*flushfn)(callbackdata, data1, len1);
+    if (len2 && len == len1)
+      len += (*flushfn)(callbackdata, data2, len2);
+    result += len;
+  }
+  consume(searchdata, flushpos - searchdata->diskpos);
   searchdata->diskpos = flushpos;
   return result;
 }
 
 size_t search_data_buffer_flush_remaining (struct search_data_buffer_struct* searchdata, FILE* dst)
 {
-  size_t result;
-  if (dst)
-    result = fwrite(searchdata->data, 1, searchdata->datalen, dst);
-  else
-    result = searchdata->datalen;
-  searchdata->diskpos += searchdata->datalen;
-  searchdata->datalen = 0;
-  return result;
+  return search_data_buffer_flush_fn(searchdata, searchdata->diskpos + searchdata->spilllen + searchdata->datalen, (dst ? write_file : NULL), dst);
 }
 
 size_t search_data_buffer_flush_remaining_fn (struct search_data_buffer_struct* searchdata, search_data_buffer_output_fn flushfn, void* callbackdata)
 {
-  size_t result;
-  if (flushfn)
-    result = (*flushfn)(callbackdata, searchdata->data, searchdata->datalen);
-  else
-    result = searchdata->datalen;
-  searchdata->diskpos += searchdata->datalen;
-  searchdata->datalen = 0;
-  return result;
+  return search_data_buffer_flush_fn(searchdata, searchdata->diskpos + searchdata->spilllen + searchdata->datalen, flushfn, callbackdata);
 }
 
 size_t search_data_buffer_get_pos (struct search_data_buffer_struct* searchdata)
@@ -113,13 +293,76 @@ size_t search_data_buffer_get_pos (struct search_data_buffer_struct* searchdata)
 
 size_t search_data_buffer_get_len (struct search_data_buffer_struct* searchdata)
 {
-  return searchdata->datalen;
+  return searchdata->spilllen + searchdata->datalen;
 }
 
 const char* search_data_buffer_get_at_pos (struct search_data_buffer_struct* searchdata, size_t pos)
 {
-  if (pos < searchdata->diskpos || pos >= searchdata->diskpos + searchdata->datalen)
+  if (pos < searchdata->diskpos || pos >= searchdata->diskpos + searchdata->spilllen + searchdata->datalen)
     return NULL;
-  return searchdata->data + (pos - searchdata->diskpos);
+  return search_data_buffer_get_contiguous(searchdata, pos, searchdata->diskpos + searchdata->spilllen + searchdata->datalen - pos);
 }
 
+size_t search_data_buffer_get_view (struct search_data_buffer_struct* searchdata, size_t pos, const char** data1, size_t* len1, const char** data2, size_t* len2)
+{
+  size_t len;
+  if (pos < searchdata->diskpos || pos >= searchdata->diskpos + searchdata->spilllen + searchdata->datalen) {
+    *data1 = NULL;
+    *len1 = 0;
+    *data2 = NULL;
+    *len2 = 0;
+    return 0;
+  }
+  //data spilled to disk is read back up to the end of the spilled data, at most the maximum memory size at a time
+  if (pos - searchdata->diskpos < searchdata->spilllen) {
+    len = searchdata->spilllen - (pos - searchdata->diskpos);
+    if (searchdata->maxmemory && len > searchdata->maxmemory)
+      len = searchdata->maxmemory;
+    *data2 = NULL;
+    *len2 = 0;
+    if (get_read_buffer(searchdata, len) == NULL || spill_read(searchdata, pos - searchdata->diskpos, len, searchdata->readbuffer) != 0) {
+      *data1 = NULL;
+      *len1 = 0;
+      return 0;
+    }
+    *data1 = searchdata->readbuffer;
+    *len1 = len;
+    return len;
+  }
+  return get_views(searchdata, pos - searchdata->diskpos - searchdata->spilllen, searchdata->diskpos + searchdata->spilllen + searchdata->datalen - pos, data1, len1, data2, len2);
+}
+
+const char* search_data_buffer_get_contiguous (struct search_data_buffer_struct* searchdata, size_t pos, size_t len)
+{
+  const char* data1;
+  const char* data2;
+  size_t len1;
+  size_t len2;
+  size_t offset;
+  size_t spilled;
+  if (pos < searchdata->diskpos || len == 0 || pos - searchdata->diskpos > searchdata->spilllen + searchdata->datalen || len > searchdata->spilllen + searchdata->datalen - (pos - searchdata->diskpos))
+    return NULL;
+  offset = pos - searchdata->diskpos;
+  //read data spilled to disk back into a separate buffer followed by the data in memory
+  if (offset < searchdata->spilllen) {
+    spilled = (len < searchdata->spilllen - offset ? len : searchdata->spilllen - offset);
+    if (get_read_buffer(searchdata, len) == NULL || spill_read(searchdata, offset, spilled, searchdata->readbuffer) != 0)
+      return NULL;
+    if (len > spilled) {
+      get_views(searchdata, 0, len - spilled, &data1, &len1, &data2, &len2);
+      memcpy(searchdata->readbuffer + spilled, data1, len1);
+      if (len2)
+        memcpy(searchdata->readbuffer + spilled + len1, data2, len2);
+    }
+    return searchdata->readbuffer;
+  }
+  offset -= searchdata->spilllen;
+  //move the data to the start of the ring only when the requested range wraps around
+  get_views(searchdata, offset, len, &data1, &len1, &data2, &len2);
+  if (len2) {
+    if (set_alloc(searchdata, searchdata->dataalloclen) != 0)
+      return NULL;
+    return searchdata->data + offset;
+  }
+  return data1;
+}
@@ -4,7 +4,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-/* C library for buffering and flushing data to disk while it is being searched */
+/* C library for buffering and flushing data to disk while it is being searched, using a ring buffer growing in powers of 2 */
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,6 +24,12 @@ void deinitialize_search_data_buffer (struct search_data_buffer_struct* searchda
 //reset
 void reset_search_data_buffer (struct search_data_buffer_struct* searchdata);
 
+//set maximum number of bytes kept in memory, older data that isn't flushed yet is spilled to an unlinked temporary file beyond that (0 for no maximum, the default)
+void search_data_buffer_set_max_memory (struct search_data_buffer_struct* searchdata, size_t maxmemory);
+
+//get number of bytes in buffer that are spilled to disk
+size_t search_data_buffer_get_spilled (struct search_data_buffer_struct* searchdata);
+
 //add data
 void search_data_buffer_add (struct search_data_buffer_struct* searchdata, const char* data, size_t datalen);
 
@@ -45,9 +51,16 @@ size_t search_data_buffer_get_pos (struct search_data_buffer_struct* searchdata)
 //get number of bytes in buffer (not flushed yet)
 size_t search_data_buffer_get_len (struct search_data_buffer_struct* searchdata);
 
-//get pointer to buffer
+//get pointer to buffered data from pos up to the end of the buffer (moves the data if it wraps around the end of the ring, data spilled to disk is read back into a separate buffer valid until the next call)
 const char* search_data_buffer_get_at_pos (struct search_data_buffer_struct* searchdata, size_t pos);
 
+//get buffered data from pos up to the end of the buffer without moving it, as 1 or 2 segments (data2 is NULL if the data doesn't wrap around), returns total length
+//if pos is spilled to disk data1 is read back up to the end of the spilled data (at most the maximum memory size), call again after that for the rest
+size_t search_data_buffer_get_view (struct search_data_buffer_struct* searchdata, size_t pos, const char** data1, size_t* len1, const char** data2, size_t* len2);
+
+//get pointer to len bytes of buffered data at pos as a single block (moves the data only if that range wraps around, reads it back if spilled to disk), returns NULL if not all in buffer
+const char* search_data_buffer_get_contiguous (struct search_data_buffer_struct* searchdata, size_t pos, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,117 @@
+#define _FILE_OFFSET_BITS 64
+#include "dir_scanner.h"
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#define PATH_SEPARATOR '\\'
+#else
+#include <dirent.h>
+#define PATH_SEPARATOR '/'
+#endif
+
+static char* join_path (const char* path, const char* name)
+{
+  char* result;
+  size_t pathlen = strlen(path);
+  size_t namelen = strlen(name);
+  if ((result = (char*)malloc(pathlen + namelen + 2)) == NULL)
+    return NULL;
+  memcpy(result, path, pathlen);
+  if (pathlen > 0 && path[pathlen - 1] != '/' && path[pathlen - 1] != PATH_SEPARATOR)
+    result[pathlen++] = PATH_SEPARATOR;
+  memcpy(result + pathlen, name, namelen + 1);
+  return result;
+}
+
+#ifdef _WIN32
+static int scan_directory (const char* path, dir_scanner_fn filefn, void* callbackdata)
+{
+  HANDLE search;
+  WIN32_FIND_DATAA entry;
+  char* pattern;
+  char* entrypath;
+  int failed = 0;
+  int status = 0;
+  if ((pattern = join_path(path, "*")) == NULL)
+    return -1;
+  search = FindFirstFileA(pattern, &entry);
+  free(pattern);
+  if (search == INVALID_HANDLE_VALUE)
+    return -1;
+  do {
+    //skip ".", ".." and reparse points (symbolic links and junctions)
+    if (strcmp(entry.cFileName, ".") == 0 || strcmp(entry.cFileName, "..") == 0 || (entry.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+      continue;
+    if ((entrypath = join_path(path, entry.cFileName)) == NULL) {
+      status = -1;
+      break;
+    }
+    if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      if ((status = scan_directory(entrypath, filefn, callbackdata)) == -1) {
+        failed = 1;
+        status = 0;
+      }
+    } else {
+      status = (*filefn)(callbackdata, entrypath, ((unsigned long long)entry.nFileSizeHigh << 32) | entry.nFileSizeLow);
+    }
+    free(entrypath);
+  } while (status == 0 && FindNextFileA(search, &entry));
+  FindClose(search);
+  return (status == 0 && failed ? -1 : status);
+}
+#else
+static int scan_directory (const char* path, dir_scanner_fn filefn, void* callbackdata)
+{
+  DIR* dir;
+  struct dirent* entry;
+  struct stat st;
+  char* entrypath;
+  int failed = 0;
+  int status = 0;
+  if ((dir = opendir(path)) == NULL)
+    return -1;
+  while (status == 0 && (entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    if ((entrypath = join_path(path, entry->d_name)) == NULL) {
+      status = -1;
+      break;
+    }
+    //symbolic links are not followed so links to parent directories can't cause loops
+    if (lstat(entrypath, &st) != 0) {
+      failed = 1;
+    } else if (S_ISDIR(st.st_mode)) {
+      if ((status = scan_directory(entrypath, filefn, callbackdata)) == -1) {
+        failed = 1;
+        status = 0;
+      }
+    } else if (S_ISREG(st.st_mode)) {
+      status = (*filefn)(callbackdata, entrypath, st.st_size);
+    }
+    free(entrypath);
+  }
+  closedir(dir);
+  return (status == 0 && failed ? -1 : status);
+}
+#endif
+
+int dir_scanner_scan (const char* path, dir_scanner_fn filefn, void* callbackdata)
+{
+#ifdef _WIN32
+  struct _stati64 st;
+  if (_stati64(path, &st) != 0)
+    return -1;
+#else
+  struct stat st;
+  if (stat(path, &st) != 0)
+    return -1;
+#endif
+  //a path given explicitly is followed even if it is a symbolic link
+  if ((st.st_mode & S_IFMT) == S_IFDIR)
+    return scan_directory(path, filefn, callbackdata);
+  if ((st.st_mode & S_IFMT) == S_IFREG)
+    return (*filefn)(callbackdata, path, st.st_size);
+  return -1;
+}
@@ -0,0 +1,23 @@
+#ifndef INCLUDED_DIR_SCANNER_H
+#define INCLUDED_DIR_SCANNER_H
+
+#include <stdlib.h>
+
+/* C library for finding all regular files in a directory tree */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//function called for each regular file found (path is only valid during the call), returns zero to continue scanning
+typedef int (*dir_scanner_fn) (void* callbackdata, const char* path, unsigned long long filesize);
+
+//call filefn for path if it is a regular file, or for all regular files below it if it is a directory (symbolic links found while scanning are not followed)
+//returns zero on success, -1 if path or one of the directories below it could not be read, or the non-zero value returned by filefn
+int dir_scanner_scan (const char* path, dir_scanner_fn filefn, void* callbackdata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_DIR_SCANNER_H
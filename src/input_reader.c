@@ -0,0 +1,81 @@
+#define _FILE_OFFSET_BITS 64
+#include "input_reader.h"
+#include <stdio.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#ifndef _WIN32
+static int read_mapped (int fd, off_t filesize, input_reader_fn processfn, void* callbackdata, int* mapped)
+{
+  void* window;
+  size_t windowlen;
+  off_t pos = 0;
+  int status = 0;
+  //map the file one window at a time so large files also fit in a 32-bit address space
+  while (pos < filesize && status == 0) {
+    windowlen = (filesize - pos < INPUT_READER_MAP_WINDOW_SIZE ? (size_t)(filesize - pos) : INPUT_READER_MAP_WINDOW_SIZE);
+    if ((window = mmap(NULL, windowlen, PROT_READ, MAP_PRIVATE, fd, pos)) == MAP_FAILED)
+      return -1;
+    *mapped = 1;
+#ifdef MADV_SEQUENTIAL
+    madvise(window, windowlen, MADV_SEQUENTIAL);
+#endif
+    status = (*processfn)(callbackdata, (const char*)window, windowlen);
+    munmap(window, windowlen);
+    pos += windowlen;
+  }
+  return status;
+}
+#endif
+
+static int read_stream (FILE* src, size_t buffersize, input_reader_fn processfn, void* callbackdata)
+{
+  char* buf;
+  size_t buflen;
+  int status = 0;
+  if ((buf = (char*)malloc(buffersize ? buffersize : INPUT_READER_BUFFER_SIZE)) == NULL)
+    return -1;
+  while (status == 0 && (buflen = fread(buf, 1, (buffersize ? buffersize : INPUT_READER_BUFFER_SIZE), src)) > 0)
+    status = (*processfn)(callbackdata, buf, buflen);
+  if (status == 0 && ferror(src))
+    status = -1;
+  free(buf);
+  return status;
+}
+
+int input_reader_read (const char* filename, size_t buffersize, input_reader_fn processfn, void* callbackdata)
+{
+  FILE* src;
+  int status;
+  if (!filename)
+    return read_stream(stdin, buffersize, processfn, callbackdata);
+#ifndef _WIN32
+  {
+    //memory map regular files
+    int fd;
+    int mapped = 0;
+    struct stat st;
+    if ((fd = open(filename, O_RDONLY)) == -1)
+      return -1;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      //fall back to reading if the file can't be mapped at all
+      status = read_mapped(fd, st.st_size, processfn, callbackdata, &mapped);
+      if (mapped) {
+        close(fd);
+        return status;
+      }
+    }
+    close(fd);
+  }
+#endif
+  if ((src = fopen(filename, "rb")) == NULL)
+    return -1;
+  status = read_stream(src, buffersize, processfn, callbackdata);
+  fclose(src);
+  return status;
+}
@@ -0,0 +1,29 @@
+#ifndef INCLUDED_INPUT_READER_H
+#define INCLUDED_INPUT_READER_H
+
+#include <stdlib.h>
+
+/* C library for reading input files in large blocks, memory mapping regular files where possible */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//default size of the buffer used for reading input that can't be memory mapped
+#define INPUT_READER_BUFFER_SIZE (1024 * 1024)
+
+//size of the windows in which regular files are memory mapped (must be a multiple of the page size)
+#define INPUT_READER_MAP_WINDOW_SIZE (64 * 1024 * 1024)
+
+//function called for each block of input data (data is only valid during the call), returns zero to continue reading
+typedef int (*input_reader_fn) (void* callbackdata, const char* data, size_t datalen);
+
+//read file (or standard input if filename is NULL) and call processfn for each block of data
+//returns zero on success, -1 if the file could not be opened or read, or the non-zero value returned by processfn
+int input_reader_read (const char* filename, size_t buffersize, input_reader_fn processfn, void* callbackdata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_INPUT_READER_H
@@ -0,0 +1,87 @@
+#include "match_index.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MATCH_INDEX_MIN_ALLOC 1024
+
+struct match_index {
+  struct match_index_record* records;
+  size_t count;
+  size_t alloc;
+  int sorted;
+};
+
+struct match_index* match_index_create ()
+{
+  struct match_index* index;
+  if ((index = (struct match_index*)malloc(sizeof(struct match_index))) == NULL)
+    return NULL;
+  index->records = NULL;
+  index->count = 0;
+  index->alloc = 0;
+  index->sorted = 1;
+  return index;
+}
+
+int match_index_add (struct match_index* index, unsigned long long offset, size_t length, int matchid)
+{
+  struct match_index_record* record;
+  if (index->count == index->alloc) {
+    size_t newalloc = (index->alloc ? index->alloc * 2 : MATCH_INDEX_MIN_ALLOC);
+    if ((record = (struct match_index_record*)realloc(index->records, newalloc * sizeof(struct match_index_record))) == NULL)
+      return -1;
+    index->records = record;
+    index->alloc = newalloc;
+  }
+  record = &index->records[index->count++];
+  record->offset = offset;
+  record->length = (length < 0xFFFFFFFF ? (uint32_t)length : 0xFFFFFFFF);
+  record->matchid = (uint32_t)matchid;
+  //matches of one expression arrive in order, so sorting is only needed when several expressions report matches
+  if (index->sorted && index->count > 1 && (record[-1].offset > record->offset || (record[-1].offset == record->offset && (record[-1].matchid > record->matchid || (record[-1].matchid == record->matchid && record[-1].length > record->length)))))
+    index->sorted = 0;
+  return 0;
+}
+
+static int compare_records (const void* a, const void* b)
+{
+  const struct match_index_record* recorda = (const struct match_index_record*)a;
+  const struct match_index_record* recordb = (const struct match_index_record*)b;
+  if (recorda->offset != recordb->offset)
+    return (recorda->offset < recordb->offset ? -1 : 1);
+  if (recorda->matchid != recordb->matchid)
+    return (recorda->matchid < recordb->matchid ? -1 : 1);
+  if (recorda->length != recordb->length)
+    return (recorda->length < recordb->length ? -1 : 1);
+  return 0;
+}
+
+int match_index_write (struct match_index* index, const char* filename)
+{
+  struct match_index_header header;
+  FILE* dst;
+  int status = 0;
+  if (!index->sorted) {
+    qsort(index->records, index->count, sizeof(struct match_index_record), compare_records);
+    index->sorted = 1;
+  }
+  memcpy(header.magic, MATCH_INDEX_MAGIC, sizeof(header.magic));
+  header.version = MATCH_INDEX_VERSION;
+  header.byteorder = MATCH_INDEX_BYTE_ORDER;
+  header.count = index->count;
+  if ((dst = fopen(filename, "wb")) == NULL)
+    return -1;
+  if (fwrite(&header, sizeof(header), 1, dst) != 1 || (index->count && fwrite(index->records, sizeof(struct match_index_record), index->count, dst) != index->count))
+    status = -1;
+  if (fclose(dst) != 0)
+    status = -1;
+  return status;
+}
+
+void match_index_free (struct match_index* index)
+{
+  if (index) {
+    free(index->records);
+    free(index);
+  }
+}
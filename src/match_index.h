@@ -0,0 +1,52 @@
+#ifndef INCLUDED_MATCH_INDEX_H
+#define INCLUDED_MATCH_INDEX_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* C library for writing a sorted binary index of match positions */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//identification at the start of an index file
+#define MATCH_INDEX_MAGIC "P2FINDEX"
+#define MATCH_INDEX_VERSION 1
+#define MATCH_INDEX_BYTE_ORDER 0x01020304
+
+//header at the start of an index file, followed by count records (all values in the byte order of the system that wrote the file, which can be recognized by byteorder)
+struct match_index_header {
+  char magic[8];                        //MATCH_INDEX_MAGIC (not NULL terminated)
+  uint32_t version;                     //MATCH_INDEX_VERSION
+  uint32_t byteorder;                   //MATCH_INDEX_BYTE_ORDER as written on the system that wrote the file
+  uint64_t count;                       //number of records
+};
+
+//record of a match, records are sorted by offset, then by matchid and length, so a file can be memory mapped and searched with a binary search
+struct match_index_record {
+  uint64_t offset;                      //offset of the match in the input
+  uint32_t length;                      //length of the match (0xFFFFFFFF for matches of 4 GB or more)
+  uint32_t matchid;                     //id of the pattern that matched
+};
+
+//object collecting matches
+struct match_index;
+
+//create object for collecting matches, returns NULL on memory allocation error
+struct match_index* match_index_create ();
+
+//add a match, returns zero on success or -1 on memory allocation error
+int match_index_add (struct match_index* index, unsigned long long offset, size_t length, int matchid);
+
+//sort the matches and write them to an index file, returns zero on success or -1 if the file could not be written
+int match_index_write (struct match_index* index, const char* filename);
+
+//clean up object
+void match_index_free (struct match_index* index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_MATCH_INDEX_H
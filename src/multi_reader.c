@@ -0,0 +1,529 @@
+#define _FILE_OFFSET_BITS 64
+#include "multi_reader.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+#ifdef PCRE2_FINDER_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+#define open _open
+#define close _close
+#define read _read
+#define fstat _fstati64
+#define stat _stati64
+#define O_RDONLY (_O_RDONLY | _O_BINARY)
+#endif
+
+#define MULTI_READER_MAX_THREADS 8
+
+struct multi_reader_block;
+
+struct multi_reader_file {
+  size_t index;
+  int fd;
+  unsigned long long size;
+  unsigned long long offset;
+  int eof;
+  int error;
+  struct multi_reader_block* first;
+  struct multi_reader_block* last;
+  struct multi_reader_file* next;
+};
+
+struct multi_reader_block {
+  char* data;
+  size_t len;
+  unsigned long long offset;
+  struct multi_reader_file* file;
+  long result;
+  int done;
+#ifdef USE_IO_URING
+  struct iovec iov;
+#endif
+  struct multi_reader_block* next;
+#ifdef PCRE2_FINDER_THREADS
+  struct multi_reader_block* poolnext;
+#endif
+};
+
+struct multi_reader {
+  int (*submit) (struct multi_reader* reader, struct multi_reader_block* block);
+  int (*wait) (struct multi_reader* reader);
+  void (*cleanup) (struct multi_reader* reader);
+  size_t inflight;
+#ifdef USE_IO_URING
+  int ringfd;
+  void* sqring;
+  size_t sqringlen;
+  void* cqring;
+  size_t cqringlen;
+  struct io_uring_sqe* sqes;
+  size_t sqeslen;
+  unsigned* sqhead;
+  unsigned* sqtail;
+  unsigned* sqmask;
+  unsigned* sqarray;
+  unsigned* cqhead;
+  unsigned* cqtail;
+  unsigned* cqmask;
+  struct io_uring_cqe* cqes;
+  unsigned tosubmit;
+#endif
+#ifdef PCRE2_FINDER_THREADS
+  pthread_t* threads;
+  size_t threadcount;
+  pthread_mutex_t lock;
+  pthread_cond_t requested;
+  pthread_cond_t completed;
+  struct multi_reader_block* requests;
+  struct multi_reader_block* lastrequest;
+  struct multi_reader_block* completions;
+  int stop;
+#endif
+};
+
+////////////////////////////////////////////////////////////////////////
+//read on the calling thread
+
+static long read_block (int fd, struct multi_reader_block* block)
+{
+  size_t pos = 0;
+  long len = 0;
+#ifdef _WIN32
+  //blocks of a file are read in order, so reading sequentially gets the data at the block's offset
+  while (pos < block->len && (len = read(fd, block->data + pos, (unsigned int)(block->len - pos))) > 0)
+    pos += len;
+#else
+  while (pos < block->len && (len = (long)pread(fd, block->data + pos, block->len - pos, (off_t)(block->offset + pos))) > 0)
+    pos += len;
+#endif
+  return (len < 0 && pos == 0 ? -1 : (long)pos);
+}
+
+static int sync_submit (struct multi_reader* reader, struct multi_reader_block* block)
+{
+  block->result = read_block(block->file->fd, block);
+  block->done = 1;
+  return 0;
+}
+
+static int sync_wait (struct multi_reader* reader)
+{
+  return 0;
+}
+
+static void sync_cleanup (struct multi_reader* reader)
+{
+}
+
+static void sync_initialize (struct multi_reader* reader)
+{
+  reader->submit = sync_submit;
+  reader->wait = sync_wait;
+  reader->cleanup = sync_cleanup;
+}
+
+////////////////////////////////////////////////////////////////////////
+//read with io_uring (Linux 5.1 or higher)
+
+#ifdef USE_IO_URING
+static int uring_submit (struct multi_reader* reader, struct multi_reader_block* block)
+{
+  struct io_uring_sqe* sqe;
+  unsigned tail = *reader->sqtail;
+  unsigned index = tail & *reader->sqmask;
+  //queue read of the rest of the block, the kernel is told about it when waiting
+  block->iov.iov_base = block->data + block->result;
+  block->iov.iov_len = block->len - block->result;
+  sqe = &reader->sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = block->file->fd;
+  sqe->addr = (unsigned long long)(size_t)&block->iov;
+  sqe->len = 1;
+  sqe->off = block->offset + block->result;
+  sqe->user_data = (unsigned long long)(size_t)block;
+  reader->sqarray[index] = index;
+  __atomic_store_n(reader->sqtail, tail + 1, __ATOMIC_RELEASE);
+  reader->tosubmit++;
+  return 0;
+}
+
+static int uring_wait (struct multi_reader* reader)
+{
+  struct io_uring_cqe* cqe;
+  struct multi_reader_block* block;
+  unsigned head;
+  long status;
+  //submit queued reads and wait for at least one to complete
+  while ((status = syscall(__NR_io_uring_enter, reader->ringfd, reader->tosubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0)) < 0) {
+    if (errno != EINTR)
+      return -1;
+  }
+  reader->tosubmit -= (unsigned)status;
+  head = *reader->cqhead;
+  while (head != __atomic_load_n(reader->cqtail, __ATOMIC_ACQUIRE)) {
+    cqe = &reader->cqes[head & *reader->cqmask];
+    block = (struct multi_reader_block*)(size_t)cqe->user_data;
+    head++;
+    if (cqe->res > 0 && block->result + cqe->res < (long)block->len) {
+      //reads can return less data than requested (e.g. when interrupted), so read the rest of the block
+      block->result += cqe->res;
+      uring_submit(reader, block);
+    } else {
+      //a read returning no data is the end of the file
+      block->result = (cqe->res < 0 ? -1 : block->result + cqe->res);
+      block->done = 1;
+    }
+  }
+  __atomic_store_n(reader->cqhead, head, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static void uring_cleanup (struct multi_reader* reader)
+{
+  if (reader->sqes)
+    munmap(reader->sqes, reader->sqeslen);
+  if (reader->cqring && reader->cqring != reader->sqring)
+    munmap(reader->cqring, reader->cqringlen);
+  if (reader->sqring)
+    munmap(reader->sqring, reader->sqringlen);
+  close(reader->ringfd);
+}
+
+static int uring_initialize (struct multi_reader* reader)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  reader->sqring = NULL;
+  reader->cqring = NULL;
+  reader->sqes = NULL;
+  reader->tosubmit = 0;
+  //fails on kernels without io_uring or when it is disabled
+  if ((reader->ringfd = (int)syscall(__NR_io_uring_setup, (unsigned)reader->inflight, &params)) < 0)
+    return -1;
+  reader->sqringlen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  reader->cqringlen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (reader->cqringlen > reader->sqringlen)
+      reader->sqringlen = reader->cqringlen;
+    reader->cqringlen = reader->sqringlen;
+  }
+  reader->sqeslen = params.sq_entries * sizeof(struct io_uring_sqe);
+  if ((reader->sqring = mmap(NULL, reader->sqringlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, reader->ringfd, IORING_OFF_SQ_RING)) == MAP_FAILED) {
+    reader->sqring = NULL;
+    uring_cleanup(reader);
+    return -1;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    reader->cqring = reader->sqring;
+  } else if ((reader->cqring = mmap(NULL, reader->cqringlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, reader->ringfd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+    reader->cqring = NULL;
+    uring_cleanup(reader);
+    return -1;
+  }
+  if ((reader->sqes = (struct io_uring_sqe*)mmap(NULL, reader->sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, reader->ringfd, IORING_OFF_SQES)) == MAP_FAILED) {
+    reader->sqes = NULL;
+    uring_cleanup(reader);
+    return -1;
+  }
+  reader->sqhead = (unsigned*)((char*)reader->sqring + params.sq_off.head);
+  reader->sqtail = (unsigned*)((char*)reader->sqring + params.sq_off.tail);
+  reader->sqmask = (unsigned*)((char*)reader->sqring + params.sq_off.ring_mask);
+  reader->sqarray = (unsigned*)((char*)reader->sqring + params.sq_off.array);
+  reader->cqhead = (unsigned*)((char*)reader->cqring + params.cq_off.head);
+  reader->cqtail = (unsigned*)((char*)reader->cqring + params.cq_off.tail);
+  reader->cqmask = (unsigned*)((char*)reader->cqring + params.cq_off.ring_mask);
+  reader->cqes = (struct io_uring_cqe*)((char*)reader->cqring + params.cq_off.cqes);
+  reader->submit = uring_submit;
+  reader->wait = uring_wait;
+  reader->cleanup = uring_cleanup;
+  return 0;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////
+//read with a pool of threads calling pread()
+
+#if defined(PCRE2_FINDER_THREADS) && !defined(_WIN32)
+static void* pool_thread (void* arg)
+{
+  struct multi_reader* reader = (struct multi_reader*)arg;
+  struct multi_reader_block* block;
+  pthread_mutex_lock(&reader->lock);
+  while (1) {
+    while (!reader->requests && !reader->stop)
+      pthread_cond_wait(&reader->requested, &reader->lock);
+    if (!reader->requests)
+      break;
+    block = reader->requests;
+    if ((reader->requests = block->poolnext) == NULL)
+      reader->lastrequest = NULL;
+    pthread_mutex_unlock(&reader->lock);
+    block->result = read_block(block->file->fd, block);
+    pthread_mutex_lock(&reader->lock);
+    block->poolnext = reader->completions;
+    reader->completions = block;
+    pthread_cond_signal(&reader->completed);
+  }
+  pthread_mutex_unlock(&reader->lock);
+  return NULL;
+}
+
+static int pool_submit (struct multi_reader* reader, struct multi_reader_block* block)
+{
+  pthread_mutex_lock(&reader->lock);
+  block->poolnext = NULL;
+  if (reader->lastrequest)
+    reader->lastrequest->poolnext = block;
+  else
+    reader->requests = block;
+  reader->lastrequest = block;
+  pthread_cond_signal(&reader->requested);
+  pthread_mutex_unlock(&reader->lock);
+  return 0;
+}
+
+static int pool_wait (struct multi_reader* reader)
+{
+  struct multi_reader_block* block;
+  //wait for at least one read to complete, the data of completed blocks is only used on this thread
+  pthread_mutex_lock(&reader->lock);
+  while (!reader->completions)
+    pthread_cond_wait(&reader->completed, &reader->lock);
+  block = reader->completions;
+  reader->completions = NULL;
+  pthread_mutex_unlock(&reader->lock);
+  while (block) {
+    block->done = 1;
+    block = block->poolnext;
+  }
+  return 0;
+}
+
+static void pool_cleanup (struct multi_reader* reader)
+{
+  size_t i;
+  pthread_mutex_lock(&reader->lock);
+  reader->stop = 1;
+  pthread_cond_broadcast(&reader->requested);
+  pthread_mutex_unlock(&reader->lock);
+  for (i = 0; i < reader->threadcount; i++)
+    pthread_join(reader->threads[i], NULL);
+  free(reader->threads);
+  pthread_cond_destroy(&reader->completed);
+  pthread_cond_destroy(&reader->requested);
+  pthread_mutex_destroy(&reader->lock);
+}
+
+static int pool_initialize (struct multi_reader* reader)
+{
+  size_t count = (reader->inflight < MULTI_READER_MAX_THREADS ? reader->inflight : MULTI_READER_MAX_THREADS);
+  if ((reader->threads = (pthread_t*)malloc(count * sizeof(pthread_t))) == NULL)
+    return -1;
+  pthread_mutex_init(&reader->lock, NULL);
+  pthread_cond_init(&reader->requested, NULL);
+  pthread_cond_init(&reader->completed, NULL);
+  reader->requests = NULL;
+  reader->lastrequest = NULL;
+  reader->completions = NULL;
+  reader->stop = 0;
+  for (reader->threadcount = 0; reader->threadcount < count; reader->threadcount++) {
+    if (pthread_create(&reader->threads[reader->threadcount], NULL, pool_thread, reader) != 0)
+      break;
+  }
+  if (reader->threadcount == 0) {
+    pool_cleanup(reader);
+    return -1;
+  }
+  reader->submit = pool_submit;
+  reader->wait = pool_wait;
+  reader->cleanup = pool_cleanup;
+  return 0;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////
+//schedule reads over the files
+
+static struct multi_reader_file* open_file (const char* filename, size_t index)
+{
+  struct multi_reader_file* file;
+  struct stat st;
+  if ((file = (struct multi_reader_file*)malloc(sizeof(struct multi_reader_file))) == NULL)
+    return NULL;
+  file->index = index;
+  file->size = 0;
+  file->offset = 0;
+  file->eof = 0;
+  file->error = 0;
+  file->first = NULL;
+  file->last = NULL;
+  file->next = NULL;
+  //only regular files are read, at the size they have when opened
+  if ((file->fd = open(filename, O_RDONLY)) == -1 || fstat(file->fd, &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG)
+    file->error = 1;
+  else
+    file->size = st.st_size;
+  return file;
+}
+
+static void close_file (struct multi_reader_file* file)
+{
+  if (file->fd != -1)
+    close(file->fd);
+  free(file);
+}
+
+int multi_reader_read (const char** filenames, size_t filecount, size_t blocksize, unsigned int queuedepth, multi_reader_fn processfn, multi_reader_done_fn donefn, void* callbackdata)
+{
+  struct multi_reader reader;
+  struct multi_reader_block* blocks;
+  struct multi_reader_block* freeblocks = NULL;
+  struct multi_reader_block* block;
+  struct multi_reader_file* files = NULL;
+  struct multi_reader_file* lastfile = NULL;
+  struct multi_reader_file** pfile;
+  struct multi_reader_file* file;
+  size_t nextfile = 0;
+  size_t inflight = 0;
+  size_t i;
+  int status = 0;
+  if (!blocksize)
+    blocksize = MULTI_READER_BLOCK_SIZE;
+  reader.inflight = (queuedepth ? queuedepth : MULTI_READER_QUEUE_DEPTH);
+  //allocate the buffers of the reads in flight
+  if ((blocks = (struct multi_reader_block*)malloc(reader.inflight * sizeof(struct multi_reader_block))) == NULL)
+    return -1;
+  for (i = 0; i < reader.inflight; i++) {
+    if ((blocks[i].data = (char*)malloc(blocksize)) == NULL) {
+      while (i-- > 0)
+        free(blocks[i].data);
+      free(blocks);
+      return -1;
+    }
+    blocks[i].next = freeblocks;
+    freeblocks = &blocks[i];
+  }
+  //use the best method available
+#ifdef USE_IO_URING
+  if (uring_initialize(&reader) != 0)
+#endif
+#if defined(PCRE2_FINDER_THREADS) && !defined(_WIN32)
+  if (pool_initialize(&reader) != 0)
+#endif
+  sync_initialize(&reader);
+  while (status == 0 && (files || nextfile < filecount)) {
+    //request the next blocks of the open files in the order they were opened, opening more files while there are blocks left
+    file = files;
+    while (freeblocks && (file || nextfile < filecount)) {
+      if (!file) {
+        if ((file = open_file(filenames[nextfile], nextfile)) == NULL) {
+          status = -1;
+          break;
+        }
+        nextfile++;
+        if (lastfile)
+          lastfile->next = file;
+        else
+          files = file;
+        lastfile = file;
+      }
+      if (file->error || file->eof || file->offset >= file->size) {
+        file = file->next;
+        continue;
+      }
+      block = freeblocks;
+      freeblocks = block->next;
+      block->file = file;
+      block->offset = file->offset;
+      block->len = (file->size - file->offset < blocksize ? (size_t)(file->size - file->offset) : blocksize);
+      block->result = 0;
+      block->done = 0;
+      block->next = NULL;
+      file->offset += block->len;
+      if (file->last)
+        file->last->next = block;
+      else
+        file->first = block;
+      file->last = block;
+      inflight++;
+      (*reader.submit)(&reader, block);
+    }
+    //wait for reads to complete
+    if (inflight && (*reader.wait)(&reader) != 0) {
+      status = -1;
+      break;
+    }
+    //pass on the data of each file in order and close files that are done
+    pfile = &files;
+    lastfile = NULL;
+    while ((file = *pfile) != NULL) {
+      while (status == 0 && file->first && file->first->done) {
+        block = file->first;
+        if ((file->first = block->next) == NULL)
+          file->last = NULL;
+        inflight--;
+        if (file->error || file->eof) {
+          //skip data after a failed read or after the file got shorter
+        } else if (block->result < 0) {
+          file->error = 1;
+        } else {
+          if (block->result > 0)
+            status = (*processfn)(callbackdata, file->index, block->data, (size_t)block->result);
+          if ((size_t)block->result < block->len)
+            file->eof = 1;
+        }
+        block->next = freeblocks;
+        freeblocks = block;
+      }
+      if (status == 0 && !file->first && (file->error || file->eof || file->offset >= file->size)) {
+        if (donefn)
+          status = (*donefn)(callbackdata, file->index, (file->error ? -1 : 0));
+        *pfile = file->next;
+        close_file(file);
+      } else {
+        lastfile = file;
+        pfile = &file->next;
+      }
+    }
+  }
+  //wait for reads still in flight before releasing their buffers
+  while (1) {
+    for (file = files; file; file = file->next) {
+      while (file->first && file->first->done) {
+        file->first = file->first->next;
+        inflight--;
+      }
+    }
+    if (!inflight || (*reader.wait)(&reader) != 0)
+      break;
+  }
+  (*reader.cleanup)(&reader);
+  while (files) {
+    file = files->next;
+    close_file(files);
+    files = file;
+  }
+  for (i = 0; i < reader.inflight; i++)
+    free(blocks[i].data);
+  free(blocks);
+  return status;
+}
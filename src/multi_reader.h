@@ -0,0 +1,32 @@
+#ifndef INCLUDED_MULTI_READER_H
+#define INCLUDED_MULTI_READER_H
+
+#include <stdlib.h>
+
+/* C library for reading many input files with several large reads in flight (io_uring where available, otherwise a pool of threads calling pread()) */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//default number of reads in flight
+#define MULTI_READER_QUEUE_DEPTH 16
+
+//default size of each read
+#define MULTI_READER_BLOCK_SIZE (1024 * 1024)
+
+//function called for each block of data of a file in file order, blocks of different files can be interleaved (data is only valid during the call), returns zero to continue reading
+typedef int (*multi_reader_fn) (void* callbackdata, size_t fileindex, const char* data, size_t datalen);
+
+//function called once for each file after its last block (status is zero on success or -1 if the file could not be opened or read), returns zero to continue reading
+typedef int (*multi_reader_done_fn) (void* callbackdata, size_t fileindex, int status);
+
+//read files, calling processfn for their data and donefn at the end of each file on the calling thread
+//returns zero on success, -1 on memory allocation error, or the non-zero value returned by processfn or donefn
+int multi_reader_read (const char** filenames, size_t filecount, size_t blocksize, unsigned int queuedepth, multi_reader_fn processfn, multi_reader_done_fn donefn, void* callbackdata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_MULTI_READER_H
@@ -0,0 +1,387 @@
+#include "pcre2_finder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#define DEFAULT_CORPUS_SIZE (8 * 1024 * 1024)
+#define DEFAULT_LINE_LENGTH 80
+#define DEFAULT_ALPHABET_SIZE 26
+#define DEFAULT_DENSITY 1000
+#define DEFAULT_SEED 1
+#define MAX_PATTERNS 100
+#define ALPHABET "abcdefghijklmnopqrstuvwxyz0123456789"
+
+static const size_t patterncounts[] = {1, 10, 100};
+static const size_t chunksizes[] = {128, 4096, 1024 * 1024};
+
+////////////////////////////////////////////////////////////////////////
+
+//count heap allocations (including those made by the library and PCRE2) by wrapping the glibc allocator
+//(atomic so allocations on the library's worker threads are counted correctly)
+#ifdef __GLIBC__
+#define COUNT_ALLOCATIONS
+extern void* __libc_malloc (size_t size);
+extern void* __libc_calloc (size_t nmemb, size_t size);
+extern void* __libc_realloc (void* ptr, size_t size);
+extern void __libc_free (void* ptr);
+
+static unsigned long long allocations = 0;
+
+void* malloc (size_t size)
+{
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void* calloc (size_t nmemb, size_t size)
+{
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(nmemb, size);
+}
+
+void* realloc (void* ptr, size_t size)
+{
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+
+void free (void* ptr)
+{
+  __libc_free(ptr);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////
+
+struct corpus_struct {
+  char* data;
+  size_t datalen;
+  size_t linelength;
+  size_t alphabetsize;
+  size_t density;
+  unsigned long long seed;
+  size_t needles;
+};
+
+struct result_struct {
+  size_t patterns;
+  size_t chunksize;
+  int literal;
+  int caseless;
+  size_t matches;
+  double seconds;
+  unsigned long long setupallocations;
+  unsigned long long allocations;
+};
+
+static unsigned long long random_next (unsigned long long* state)
+{
+  //xorshift64* generator, the same seed always gives the same corpus
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+static int generate_corpus (struct corpus_struct* corpus)
+{
+  unsigned long long state = (corpus->seed ? corpus->seed : DEFAULT_SEED);
+  unsigned long long threshold;
+  char needle[8];
+  size_t pos = 0;
+  size_t linepos = 0;
+  if ((corpus->data = (char*)malloc(corpus->datalen)) == NULL)
+    return -1;
+  //chance per byte of inserting a needle matching one of the patterns
+  threshold = (unsigned long long)((double)corpus->density / (1024 * 1024) * 18446744073709551615.0);
+  corpus->needles = 0;
+  while (pos < corpus->datalen) {
+    if (linepos >= corpus->linelength) {
+      corpus->data[pos++] = '\n';
+      linepos = 0;
+    } else if (random_next(&state) < threshold && corpus->datalen - pos >= 7) {
+      sprintf(needle, "qz%04ux", (unsigned int)(random_next(&state) % MAX_PATTERNS));
+      memcpy(corpus->data + pos, needle, 7);
+      pos += 7;
+      linepos += 7;
+      corpus->needles++;
+    } else {
+      corpus->data[pos++] = ALPHABET[random_next(&state) % corpus->alphabetsize];
+      linepos++;
+    }
+  }
+  return 0;
+}
+
+static int when_found (struct pcre2_finder* finder, const char* data, size_t datalen, void* callbackdata, int matchid)
+{
+  (*(size_t*)callbackdata)++;
+  return 0;
+}
+
+static double get_time ()
+{
+#if defined(CLOCK_MONOTONIC) && !defined(_WIN32)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+//peak memory use of the whole process so far (a high-water mark, so only meaningful for the entire run)
+static long get_peak_rss ()
+{
+#ifndef _WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    return usage.ru_maxrss;
+#endif
+  return -1;
+}
+
+static int run_benchmark (const struct corpus_struct* corpus, int engine, int mode, struct result_struct* result)
+{
+  struct pcre2_finder* finder;
+  char pattern[32];
+  size_t pos;
+  size_t i;
+  double starttime;
+#ifdef COUNT_ALLOCATIONS
+  unsigned long long startallocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+#endif
+  result->matches = 0;
+  if ((finder = pcre2_finder_initialize()) == NULL)
+    return -1;
+  pcre2_finder_set_engine(finder, engine);
+  pcre2_finder_set_mode(finder, mode);
+  for (i = 0; i < result->patterns; i++) {
+    sprintf(pattern, (result->literal ? "qz%04ux" : "qz%04u[x-y]"), (unsigned int)i);
+    if (pcre2_finder_add_expr(finder, pattern, (result->caseless ? PCRE2_CASELESS : 0), when_found, &result->matches, i) != 0) {
+      pcre2_finder_cleanup(finder);
+      return -1;
+    }
+  }
+  if (pcre2_finder_open(finder, pcre2_finder_output_to_null, NULL) != 0) {
+    pcre2_finder_cleanup(finder);
+    return -1;
+  }
+#ifdef COUNT_ALLOCATIONS
+  result->setupallocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - startallocations;
+  startallocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+#endif
+  //search the corpus in chunks of the specified size
+  starttime = get_time();
+  for (pos = 0; pos < corpus->datalen; pos += result->chunksize)
+    pcre2_finder_process(finder, corpus->data + pos, (corpus->datalen - pos < result->chunksize ? corpus->datalen - pos : result->chunksize));
+  pcre2_finder_close(finder);
+  result->seconds = get_time() - starttime;
+#ifdef COUNT_ALLOCATIONS
+  result->allocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - startallocations;
+#endif
+  pcre2_finder_cleanup(finder);
+  return 0;
+}
+
+static void print_result (const struct corpus_struct* corpus, const struct result_struct* result, int first)
+{
+  double seconds = (result->seconds > 0 ? result->seconds : 1e-9);
+  printf("%s    {\"patterns\": %lu, \"chunk_size\": %lu, \"type\": \"%s\", \"caseless\": %s, \"matches\": %lu, \"seconds\": %.6f, \"mb_per_second\": %.3f, \"matches_per_second\": %.1f, ",
+    (first ? "" : ",\n"),
+    (unsigned long)result->patterns, (unsigned long)result->chunksize, (result->literal ? "literal" : "regex"), (result->caseless ? "true" : "false"),
+    (unsigned long)result->matches, result->seconds, corpus->datalen / seconds / (1024 * 1024), result->matches / seconds);
+#ifdef COUNT_ALLOCATIONS
+  printf("\"setup_allocations\": %llu, \"allocations\": %llu}", result->setupallocations, result->allocations);
+#else
+  printf("\"setup_allocations\": null, \"allocations\": null}");
+#endif
+}
+
+void show_help()
+{
+  printf(
+    "Usage:  pcre2_finder_bench [-?|-h] [-n bytes] [-l length] [-a size] [-d density] [-r seed] [-e engine] [-s|-x] [-q]\n" \
+    "Parameters:\n" \
+    "  -? | -h     \tshow help\n" \
+    "  -n bytes    \tcorpus size (default is 8 MB)\n" \
+    "  -l length   \tcorpus line length (default is 80)\n" \
+    "  -a size     \tnumber of different characters in the corpus, 1 to 36 (default is 26)\n" \
+    "  -d density  \tnumber of inserted matches per MB of corpus (default is 1000)\n" \
+    "  -r seed     \tseed for generating the corpus (default is 1)\n" \
+    "  -e engine   \tmatching engine: dfa (default) or jit\n" \
+    "  -s          \tsearch patterns simultaneously in a single pass\n" \
+    "  -x          \tsearch patterns layered, one pass per pattern (default)\n" \
+    "  -q          \tquick run, only 1 and 10 patterns and the 2 largest chunk sizes\n" \
+    "Runs all combinations of 1, 10 and 100 patterns, chunk sizes of 128, 4096 and 1048576 bytes,\n" \
+    "literal and regular expression patterns, with and without PCRE2_CASELESS.\n" \
+    "Results are written to standard output as JSON.\n" \
+    "Version: " PCRE2_FINDER_VERSION_STRING "\n" \
+    "\n"
+  );
+}
+
+int main (int argc, char** argv)
+{
+  struct corpus_struct corpus;
+  struct result_struct result;
+  int engine = PCRE2_FINDER_ENGINE_DFA;
+  int mode = PCRE2_FINDER_MODE_LAYERED;
+  int quick = 0;
+  int first = 1;
+  long peakrss;
+  size_t p;
+  size_t c;
+  corpus.datalen = DEFAULT_CORPUS_SIZE;
+  corpus.linelength = DEFAULT_LINE_LENGTH;
+  corpus.alphabetsize = DEFAULT_ALPHABET_SIZE;
+  corpus.density = DEFAULT_DENSITY;
+  corpus.seed = DEFAULT_SEED;
+  //process command line parameters
+  {
+    int i = 0;
+    char* param;
+    int paramerror = 0;
+    while (!paramerror && ++i < argc) {
+      if (argv[i][0] == '-') {
+        param = NULL;
+        switch (tolower(argv[i][1])) {
+          case '?' :
+          case 'h' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              show_help();
+            return 0;
+          case 'n' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || (corpus.datalen = strtoul(param, NULL, 10)) == 0)
+              paramerror++;
+            break;
+          case 'l' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || (corpus.linelength = strtoul(param, NULL, 10)) == 0)
+              paramerror++;
+            break;
+          case 'a' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || (corpus.alphabetsize = strtoul(param, NULL, 10)) == 0 || corpus.alphabetsize > strlen(ALPHABET))
+              paramerror++;
+            break;
+          case 'd' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else
+              corpus.density = strtoul(param, NULL, 10);
+            break;
+          case 'r' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else
+              corpus.seed = strtoull(param, NULL, 10);
+            break;
+          case 'e' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else if (strcmp(param, "dfa") == 0)
+              engine = PCRE2_FINDER_ENGINE_DFA;
+            else if (strcmp(param, "jit") == 0)
+              engine = PCRE2_FINDER_ENGINE_JIT;
+            else
+              paramerror++;
+            break;
+          case 's' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              mode = PCRE2_FINDER_MODE_SIMULTANEOUS;
+            break;
+          case 'x' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              mode = PCRE2_FINDER_MODE_LAYERED;
+            break;
+          case 'q' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              quick = 1;
+            break;
+          default :
+            paramerror++;
+            break;
+        }
+      } else {
+        paramerror++;
+      }
+    }
+    if (paramerror) {
+      fprintf(stderr, "Invalid command line parameters\n");
+      show_help();
+      return 1;
+    }
+  }
+  //generate corpus
+  if (generate_corpus(&corpus) != 0) {
+    fprintf(stderr, "Memory allocation error\n");
+    return 2;
+  }
+  printf("{\n  \"version\": \"%s\",\n  \"engine\": \"%s\",\n  \"mode\": \"%s\",\n", PCRE2_FINDER_VERSION_STRING, (engine == PCRE2_FINDER_ENGINE_JIT ? "jit" : "dfa"), (mode == PCRE2_FINDER_MODE_SIMULTANEOUS ? "simultaneous" : "layered"));
+  printf("  \"corpus\": {\"size\": %lu, \"line_length\": %lu, \"alphabet_size\": %lu, \"density\": %lu, \"seed\": %llu, \"inserted_matches\": %lu},\n",
+    (unsigned long)corpus.datalen, (unsigned long)corpus.linelength, (unsigned long)corpus.alphabetsize, (unsigned long)corpus.density, corpus.seed, (unsigned long)corpus.needles);
+  printf("  \"results\": [\n");
+  //run all combinations
+  for (p = 0; p < sizeof(patterncounts) / sizeof(patterncounts[0]) - (quick ? 1 : 0); p++) {
+    for (c = (quick ? 1 : 0); c < sizeof(chunksizes) / sizeof(chunksizes[0]); c++) {
+      for (result.literal = 1; result.literal >= 0; result.literal--) {
+        for (result.caseless = 0; result.caseless <= 1; result.caseless++) {
+          result.patterns = patterncounts[p];
+          result.chunksize = chunksizes[c];
+          if (run_benchmark(&corpus, engine, mode, &result) != 0) {
+            fprintf(stderr, "Error running benchmark with %lu patterns\n", (unsigned long)result.patterns);
+            free(corpus.data);
+            return 3;
+          }
+          print_result(&corpus, &result, first);
+          first = 0;
+          fflush(stdout);
+        }
+      }
+    }
+  }
+  printf("\n  ],\n");
+  //peak memory use is reported once as it covers all combinations run in this process
+  if ((peakrss = get_peak_rss()) >= 0)
+    printf("  \"peak_rss_kb\": %ld\n}\n", peakrss);
+  else
+    printf("  \"peak_rss_kb\": null\n}\n");
+  free(corpus.data);
+  return 0;
+}
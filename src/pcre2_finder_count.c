@@ -1,34 +1,897 @@
+#define _FILE_OFFSET_BITS 64
 #include "pcre2_finder.h"
+#include "input_reader.h"
+#include "multi_reader.h"
+#include "dir_scanner.h"
+#include "match_index.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef PCRE2_FINDER_THREADS
+#include <pthread.h>
+#endif
 
-#define READBUFFERSIZE 128
+#define SEGMENTBUFFERSIZE (1024 * 1024)
+#define SEGMENTMINSIZE (4 * 1024 * 1024)
+#define SEGMENTSYNCPOINTS 16
+#define MATCHBATCHSIZE 256
+#define TREESEGMENTSIZE (16 * 1024 * 1024)
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
 
 struct count_data_struct {
   size_t count;
   size_t* patterncounts;
+  struct match_index* index;
+  int indexerror;
+  size_t maxcount;
+  size_t found;
+  struct pcre2_finder_match matches[MATCHBATCHSIZE];
+};
+
+struct pattern_struct {
+  const char* expr;
+  int flags;
+  int engine;
+  int mode;
+  uint32_t matchlimit;
+  uint32_t depthlimit;
+  uint32_t heaplimit;
+  unsigned long long timelimit;
+  int limitpolicy;
 };
 
 static int when_found (struct pcre2_finder* finder, const char* data, size_t datalen, void* callbackdata, int matchid)
 {
-  struct count_data_struct* countdata = (struct count_data_struct*)callbackdata;
-  countdata->count++;
+  struct count_data_struct* countdata = (struct count_data_struct*)pcre2_finder_get_user_data(finder);
   countdata->patterncounts[matchid]++;
+  if (countdata->index && match_index_add(countdata->index, pcre2_finder_get_match_offset(finder), datalen, matchid) != 0)
+    countdata->indexerror = 1;
+  //stop searching when the maximum number of matches is reached
+  if (countdata->maxcount && ++countdata->found == countdata->maxcount)
+    return 1;
+  return 0;
+}
+
+static int when_found_batch (struct pcre2_finder* finder, const struct pcre2_finder_match* matches, size_t count, void* callbackdata)
+{
+  struct count_data_struct* countdata = (struct count_data_struct*)callbackdata;
+  size_t i;
+  //matches beyond the maximum number of matches are ignored and searching stops
+  if (countdata->maxcount && count > countdata->maxcount - countdata->found)
+    count = countdata->maxcount - countdata->found;
+  for (i = 0; i < count; i++)
+    countdata->patterncounts[matches[i].matchid]++;
+  countdata->found += count;
+  if (countdata->index) {
+    for (i = 0; i < count; i++) {
+      if (match_index_add(countdata->index, matches[i].offset, matches[i].datalen, matches[i].matchid) != 0)
+        countdata->indexerror = 1;
+    }
+  }
+  if (countdata->maxcount && countdata->found == countdata->maxcount)
+    return 1;
+  return 0;
+}
+
+static int process_input (void* callbackdata, const char* data, size_t datalen)
+{
+  int status;
+  if ((status = pcre2_finder_process((struct pcre2_finder*)callbackdata, data, datalen)) < 0) {
+    fprintf(stderr, "Error in pcre2_finder_process()\n");
+  }
+  //stop reading when the maximum number of matches is reached
+  return (status == PCRE2_FINDER_ABORTED ? 1 : 0);
+}
+
+static unsigned long long hash_data (unsigned long long hash, const char* data, size_t datalen)
+{
+  //FNV-1a
+  while (datalen--)
+    hash = (hash ^ (unsigned char)*data++) * 1099511628211ULL;
+  return hash;
+}
+
+static unsigned long long hash_patterns (struct pattern_struct* patterns, size_t patterncount)
+{
+  //hash of the patterns and their options, identifying the contents of the cache file
+  unsigned long long hash = 14695981039346656037ULL;
+  char options[128];
+  size_t i;
+  for (i = 0; i < patterncount; i++) {
+    hash = hash_data(hash, patterns[i].expr, strlen(patterns[i].expr) + 1);
+    hash = hash_data(hash, options, sprintf(options, "%i %i %i %lu %lu %lu %llu %i\n", patterns[i].flags, patterns[i].engine, patterns[i].mode, (unsigned long)patterns[i].matchlimit, (unsigned long)patterns[i].depthlimit, (unsigned long)patterns[i].heaplimit, patterns[i].timelimit, patterns[i].limitpolicy));
+  }
+  return hash;
+}
+
+static struct pcre2_finder* create_finder (struct pattern_struct* patterns, size_t patterncount, unsigned int threads, int stats, int independent, struct count_data_struct* countdata, const char* cachefile)
+{
+  struct pcre2_finder* finder;
+  unsigned long long key = 0;
+  int loaded = 0;
+  size_t i;
+  if ((finder = pcre2_finder_initialize()) == NULL)
+    return NULL;
+  //load compiled patterns from the cache file, or compile them and save them for next time
+  if (cachefile) {
+    key = hash_patterns(patterns, patterncount);
+    if (pcre2_finder_load(finder, cachefile, key, when_found, NULL) == 0) {
+      loaded = 1;
+    } else {
+      pcre2_finder_cleanup(finder);
+      if ((finder = pcre2_finder_initialize()) == NULL)
+        return NULL;
+    }
+  }
+  if (!loaded) {
+    for (i = 0; i < patterncount; i++) {
+      pcre2_finder_set_engine(finder, patterns[i].engine);
+      pcre2_finder_set_mode(finder, patterns[i].mode);
+      pcre2_finder_set_match_limits(finder, patterns[i].matchlimit, patterns[i].depthlimit, patterns[i].heaplimit);
+      pcre2_finder_set_time_limit(finder, patterns[i].timelimit);
+      pcre2_finder_set_limit_policy(finder, patterns[i].limitpolicy);
+      pcre2_finder_add_expr(finder, patterns[i].expr, patterns[i].flags, when_found, NULL, i);
+    }
+    if (cachefile && pcre2_finder_save(finder, cachefile, key) != 0)
+      fprintf(stderr, "Error writing cache file: %s\n", cachefile);
+  }
+  if (threads)
+    pcre2_finder_set_threads(finder, threads);
+  pcre2_finder_set_stats(finder, stats);
+  pcre2_finder_set_user_data(finder, countdata);
+  //count matches in batches when searching on this thread
+  if (threads <= 1 && countdata)
+    pcre2_finder_set_match_batch(finder, countdata->matches, MATCHBATCHSIZE, when_found_batch, countdata);
+  if ((independent ? pcre2_finder_open_independent(finder) : pcre2_finder_open(finder, pcre2_finder_output_to_null, NULL)) != 0) {
+    pcre2_finder_cleanup(finder);
+    return NULL;
+  }
+  return finder;
+}
+
+static int collect_stats (struct pcre2_finder* finder, struct pcre2_finder_stats** stats, size_t* statscount)
+{
+  struct pcre2_finder_stats* nodestats;
+  size_t count;
+  size_t i;
+  //get statistics of each node and add them to those collected before (each segment has the same nodes)
+  count = pcre2_finder_get_stats(finder, NULL, 0);
+  if ((nodestats = (struct pcre2_finder_stats*)malloc((count ? count : 1) * sizeof(struct pcre2_finder_stats))) == NULL)
+    return -1;
+  pcre2_finder_get_stats(finder, nodestats, count);
+  if (!*stats) {
+    *stats = nodestats;
+    *statscount = count;
+    return 0;
+  }
+  for (i = 0; i < count && i < *statscount; i++) {
+    (*stats)[i].bytesin += nodestats[i].bytesin;
+    (*stats)[i].bytesout += nodestats[i].bytesout;
+    (*stats)[i].matches += nodestats[i].matches;
+    (*stats)[i].searches += nodestats[i].searches;
+    (*stats)[i].partialcarries += nodestats[i].partialcarries;
+    if (nodestats[i].partialpeak > (*stats)[i].partialpeak)
+      (*stats)[i].partialpeak = nodestats[i].partialpeak;
+    (*stats)[i].searchtime += nodestats[i].searchtime;
+    (*stats)[i].limitskips += nodestats[i].limitskips;
+  }
+  free(nodestats);
+  return 0;
+}
+
+static void show_stats (struct pcre2_finder_stats* stats, size_t statscount)
+{
+  size_t i;
+  for (i = 0; i < statscount; i++) {
+    if (stats[i].exprcount > 1)
+      fprintf(stderr, "patterns %i-%i:", stats[i].matchid + 1, stats[i].matchid + (int)stats[i].exprcount);
+    else
+      fprintf(stderr, "pattern %i:", stats[i].matchid + 1);
+    fprintf(stderr, " %llu bytes in, %llu bytes out, %llu matches, %llu searches taking %.3f ms, %llu partial matches carried (largest %lu bytes), %llu skipped after hitting a limit\n", stats[i].bytesin, stats[i].bytesout, stats[i].matches, stats[i].searches, (double)stats[i].searchtime / 1000000, stats[i].partialcarries, (unsigned long)stats[i].partialpeak, stats[i].limitskips);
+  }
+}
+
+struct file_count_struct {
+  const char** srcfiles;
+  struct pcre2_finder* finder;
+  struct pcre2_finder** streams;
+  struct count_data_struct countdata;
+  struct pcre2_finder_stats** stats;
+  size_t* statscount;
+  int independent;
+  int status;
+};
+
+static int process_file_data (void* callbackdata, size_t fileindex, const char* data, size_t datalen)
+{
+  struct file_count_struct* filecount = (struct file_count_struct*)callbackdata;
+  struct pcre2_finder* stream;
+  int status;
+  //open a stream sharing the compiled patterns when the first data of the file arrives
+  if ((stream = filecount->streams[fileindex]) == NULL) {
+    if ((stream = pcre2_finder_create_stream(filecount->finder)) == NULL)
+      return 2;
+    pcre2_finder_set_user_data(stream, &filecount->countdata);
+    pcre2_finder_set_match_batch(stream, filecount->countdata.matches, MATCHBATCHSIZE, when_found_batch, &filecount->countdata);
+    if ((filecount->independent ? pcre2_finder_open_independent(stream) : pcre2_finder_open(stream, pcre2_finder_output_to_null, NULL)) != 0) {
+      pcre2_finder_cleanup(stream);
+      return 2;
+    }
+    filecount->streams[fileindex] = stream;
+  }
+  if ((status = pcre2_finder_process(stream, data, datalen)) < 0) {
+    fprintf(stderr, "Error in pcre2_finder_process()\n");
+  }
+  //stop reading all files when the maximum number of matches is reached
+  return (status == PCRE2_FINDER_ABORTED ? 1 : 0);
+}
+
+static int process_file_done (void* callbackdata, size_t fileindex, int status)
+{
+  struct file_count_struct* filecount = (struct file_count_struct*)callbackdata;
+  struct pcre2_finder* stream;
+  if (status != 0) {
+    fprintf(stderr, "Error reading file: %s\n", filecount->srcfiles[fileindex]);
+    filecount->status = 5;
+  }
+  //matches of one file don't continue in the next one, so each file is closed separately
+  if ((stream = filecount->streams[fileindex]) != NULL) {
+    if (pcre2_finder_close(stream) < 0) {
+      fprintf(stderr, "Error in pcre2_finder_close()\n");
+    }
+    if (filecount->stats && collect_stats(stream, filecount->stats, filecount->statscount) != 0) {
+      pcre2_finder_cleanup(stream);
+      filecount->streams[fileindex] = NULL;
+      return 2;
+    }
+    pcre2_finder_cleanup(stream);
+    filecount->streams[fileindex] = NULL;
+  }
+  return 0;
+}
+
+static int count_files (const char** srcfiles, size_t srcfilecount, size_t blocksize, struct pattern_struct* patterns, size_t patterncount, int independent, size_t maxcount, size_t* patterncounts, struct pcre2_finder_stats** stats, size_t* statscount, const char* cachefile)
+{
+  struct file_count_struct filecount;
+  size_t i;
+  int status;
+  //compile the patterns once, each file is searched by its own stream sharing them
+  if ((filecount.finder = create_finder(patterns, patterncount, 0, (stats != NULL), independent, NULL, cachefile)) == NULL)
+    return 4;
+  if ((filecount.streams = (struct pcre2_finder**)calloc(srcfilecount, sizeof(struct pcre2_finder*))) == NULL) {
+    pcre2_finder_cleanup(filecount.finder);
+    return 2;
+  }
+  filecount.srcfiles = srcfiles;
+  filecount.countdata.count = 0;
+  filecount.countdata.patterncounts = patterncounts;
+  filecount.countdata.index = NULL;
+  filecount.countdata.indexerror = 0;
+  filecount.countdata.maxcount = maxcount;
+  filecount.countdata.found = 0;
+  filecount.stats = stats;
+  filecount.statscount = statscount;
+  filecount.independent = independent;
+  filecount.status = 0;
+  //keep several reads in flight over the files, files are only opened when their data is needed
+  if ((status = multi_reader_read(srcfiles, srcfilecount, blocksize, MULTI_READER_QUEUE_DEPTH, process_file_data, process_file_done, &filecount)) < 0)
+    status = 2;
+  else if (status == 1)
+    status = 0;
+  if (!status)
+    status = filecount.status;
+  //clean up streams of files not finished because of an error
+  for (i = 0; i < srcfilecount; i++) {
+    if (filecount.streams[i])
+      pcre2_finder_cleanup(filecount.streams[i]);
+  }
+  free(filecount.streams);
+  pcre2_finder_cleanup(filecount.finder);
+  return status;
+}
+
+struct range_struct {
+  unsigned long long start;
+  unsigned long long end;
+  int last;
+  int status;
+  size_t* patterncounts;
+  struct pcre2_finder* stream;
+  unsigned long long syncpos[SEGMENTSYNCPOINTS];
+  size_t* synccounts;
+  size_t synccount;
+};
+
+static int search_block (FILE* src, struct pcre2_finder* stream, char* buf, unsigned long long* pos, unsigned long long end)
+{
+  size_t buflen;
+  //blocks end at multiples of the buffer size, so the streams of different ranges search the same blocks
+  buflen = (size_t)(SEGMENTBUFFERSIZE - *pos % SEGMENTBUFFERSIZE);
+  if (buflen > end - *pos)
+    buflen = (size_t)(end - *pos);
+  if ((buflen = fread(buf, 1, buflen, src)) == 0)
+    return -1;
+  *pos += buflen;
+  return (pcre2_finder_process(stream, buf, buflen) < 0 ? 6 : 0);
+}
+
+static int count_range (const char* srcfile, char* buf, struct range_struct* range, size_t patterncount)
+{
+  FILE* src;
+  unsigned long long pos = range->start;
+  int status = 0;
+  if ((src = fopen(srcfile, "rb")) == NULL || fseek64(src, pos, SEEK_SET) != 0) {
+    if (src)
+      fclose(src);
+    return 5;
+  }
+  range->synccount = 0;
+  while (status == 0) {
+    //remember where nothing is held back, the previous range is continued up to one of these positions (see stitch_range())
+    if (range->start && range->synccount < SEGMENTSYNCPOINTS && pcre2_finder_get_pending(range->stream) == 0) {
+      range->syncpos[range->synccount] = pos;
+      memcpy(range->synccounts + range->synccount * patterncount, range->patterncounts, patterncount * sizeof(size_t));
+      range->synccount++;
+    }
+    if (pos >= range->end)
+      break;
+    status = search_block(src, range->stream, buf, &pos, range->end);
+  }
+  //matches still in progress at the end of the range are found by continuing the search (see stitch_range())
+  if (range->last)
+    pcre2_finder_close(range->stream);
+  fclose(src);
+  return (status > 0 ? status : 0);
+}
+
+static int stitch_range (const char* srcfile, char* buf, struct range_struct** owner, struct range_struct* next, size_t patterncount)
+{
+  //continue searching with the stream that searched up to the start of the next range until both streams are at the same
+  //position without holding back data, from there on the next range finds the same matches as a sequential search
+  struct count_data_struct* countdata = (struct count_data_struct*)pcre2_finder_get_user_data((*owner)->stream);
+  FILE* src;
+  unsigned long long pos = next->start;
+  size_t i = 0;
+  size_t j;
+  int status = 0;
+  if ((src = fopen(srcfile, "rb")) == NULL || fseek64(src, pos, SEEK_SET) != 0) {
+    if (src)
+      fclose(src);
+    return 5;
+  }
+  countdata->patterncounts = (*owner)->patterncounts;
+  while (status == 0) {
+    while (i < next->synccount && next->syncpos[i] < pos)
+      i++;
+    if (i < next->synccount && next->syncpos[i] == pos && pcre2_finder_get_pending((*owner)->stream) == 0) {
+      //the matches the next range found before this position were found by continuing the search
+      for (j = 0; j < patterncount; j++)
+        next->patterncounts[j] -= next->synccounts[i * patterncount + j];
+      fclose(src);
+      *owner = next;
+      return 0;
+    }
+    if (pos >= next->end)
+      break;
+    status = search_block(src, (*owner)->stream, buf, &pos, next->end);
+  }
+  fclose(src);
+  if (status > 0)
+    return status;
+  //the search never got in step (for example in periodic data), so the matches of the next range are replaced by those found by continuing
+  memset(next->patterncounts, 0, patterncount * sizeof(size_t));
+  if (next->last)
+    pcre2_finder_close((*owner)->stream);
+  return 0;
+}
+
+#ifdef PCRE2_FINDER_THREADS
+struct segment_struct {
+  const char* srcfile;
+  struct count_data_struct countdata;
+  struct range_struct range;
+  size_t patterncount;
+  pthread_t thread;
+};
+
+static void* count_segment (void* arg)
+{
+  struct segment_struct* segment = (struct segment_struct*)arg;
+  char* buf;
+  if ((buf = (char*)malloc(SEGMENTBUFFERSIZE)) == NULL) {
+    segment->range.status = 2;
+    return NULL;
+  }
+  segment->range.status = count_range(segment->srcfile, buf, &segment->range, segment->patterncount);
+  free(buf);
+  return NULL;
+}
+
+static int count_segments (const char* srcfile, unsigned int segmentcount, struct pattern_struct* patterns, size_t patterncount, int independent, size_t* patterncounts, struct pcre2_finder_stats** stats, size_t* statscount, const char* cachefile)
+{
+  struct segment_struct* segments;
+  struct range_struct* owner;
+  struct pcre2_finder* finder;
+  FILE* src;
+  long long filesize;
+  char* buf;
+  unsigned int started = 0;
+  unsigned int i;
+  size_t j;
+  int status = 0;
+  //compile the patterns once, each segment is searched by its own stream sharing them
+  if ((finder = create_finder(patterns, patterncount, 0, (stats != NULL), independent, NULL, cachefile)) == NULL)
+    return -1;
+  //only split if the maximum match length is bounded, so partial matches end soon enough to get the segments in step
+  if (pcre2_finder_get_max_match_length(finder) == 0) {
+    pcre2_finder_cleanup(finder);
+    return -1;
+  }
+  //only split regular files large enough to be worth it
+  if ((src = fopen(srcfile, "rb")) == NULL) {
+    pcre2_finder_cleanup(finder);
+    return -1;
+  }
+  if (fseek64(src, 0, SEEK_END) != 0 || (filesize = ftell64(src)) < 0) {
+    fclose(src);
+    pcre2_finder_cleanup(finder);
+    return -1;
+  }
+  fclose(src);
+  if (filesize / segmentcount < SEGMENTMINSIZE)
+    segmentcount = (unsigned int)(filesize / SEGMENTMINSIZE);
+  if (segmentcount <= 1) {
+    pcre2_finder_cleanup(finder);
+    return -1;
+  }
+  if ((segments = (struct segment_struct*)malloc(segmentcount * sizeof(struct segment_struct))) == NULL) {
+    pcre2_finder_cleanup(finder);
+    return 2;
+  }
+  for (i = 0; i < segmentcount; i++) {
+    segments[i].srcfile = srcfile;
+    segments[i].patterncount = patterncount;
+    segments[i].range.start = filesize * i / segmentcount;
+    segments[i].range.end = filesize * (i + 1) / segmentcount;
+    segments[i].range.last = (i + 1 == segmentcount);
+    segments[i].range.status = 0;
+    segments[i].range.synccount = 0;
+    segments[i].countdata.index = NULL;
+    segments[i].countdata.indexerror = 0;
+    segments[i].countdata.maxcount = 0;
+    segments[i].countdata.found = 0;
+    segments[i].range.stream = NULL;
+    segments[i].range.synccounts = NULL;
+    if ((segments[i].range.patterncounts = (size_t*)calloc((SEGMENTSYNCPOINTS + 1) * (patterncount ? patterncount : 1), sizeof(size_t))) == NULL || (segments[i].range.stream = pcre2_finder_create_stream(finder)) == NULL) {
+      free(segments[i].range.patterncounts);
+      segmentcount = i;
+      status = 2;
+      break;
+    }
+    segments[i].range.synccounts = segments[i].range.patterncounts + patterncount;
+    segments[i].countdata.patterncounts = segments[i].range.patterncounts;
+    pcre2_finder_set_user_data(segments[i].range.stream, &segments[i].countdata);
+    pcre2_finder_set_match_batch(segments[i].range.stream, segments[i].countdata.matches, MATCHBATCHSIZE, when_found_batch, &segments[i].countdata);
+    if ((independent ? pcre2_finder_open_independent(segments[i].range.stream) : pcre2_finder_open(segments[i].range.stream, pcre2_finder_output_to_null, NULL)) != 0) {
+      free(segments[i].range.patterncounts);
+      pcre2_finder_cleanup(segments[i].range.stream);
+      segmentcount = i;
+      status = 2;
+      break;
+    }
+  }
+  while (started < segmentcount && !status) {
+    if (pthread_create(&segments[started].thread, NULL, count_segment, &segments[started]) != 0)
+      status = 2;
+    else
+      started++;
+  }
+  for (i = 0; i < started; i++)
+    pthread_join(segments[i].thread, NULL);
+  for (i = 0; i < segmentcount; i++) {
+    if (segments[i].range.status && !status)
+      status = segments[i].range.status;
+  }
+  //continue the search of each segment into the next one until they are in step
+  if (!status && started == segmentcount) {
+    if ((buf = (char*)malloc(SEGMENTBUFFERSIZE)) == NULL) {
+      status = 2;
+    } else {
+      owner = &segments[0].range;
+      for (i = 1; i < segmentcount && !status; i++)
+        status = stitch_range(srcfile, buf, &owner, &segments[i].range, patterncount);
+      free(buf);
+    }
+  }
+  //merge the counts of all segments
+  for (i = 0; i < segmentcount; i++) {
+    for (j = 0; j < patterncount; j++)
+      patterncounts[j] += segments[i].range.patterncounts[j];
+    if (stats && collect_stats(segments[i].range.stream, stats, statscount) != 0 && !status)
+      status = 2;
+    free(segments[i].range.patterncounts);
+    pcre2_finder_cleanup(segments[i].range.stream);
+  }
+  free(segments);
+  pcre2_finder_cleanup(finder);
+  return status;
+}
+#endif
+
+struct tree_file_struct {
+  char* path;
+  unsigned long long size;
+  size_t firstitem;
+  size_t itemcount;
+};
+
+struct tree_item_struct {
+  size_t fileindex;
+  struct range_struct range;
+};
+
+struct tree_worker_struct {
+  struct tree_pool_struct* pool;
+  size_t* queue;
+  size_t queuehead;
+  size_t queuetail;
+  struct count_data_struct countdata;
+  char* buf;
+#ifdef PCRE2_FINDER_THREADS
+  pthread_mutex_t queuelock;
+  pthread_t thread;
+#endif
+};
+
+struct tree_pool_struct {
+  struct tree_file_struct* files;
+  size_t filecount;
+  size_t filealloc;
+  struct tree_item_struct* items;
+  size_t itemcount;
+  struct tree_worker_struct* workers;
+  unsigned int workercount;
+  struct pcre2_finder* finder;
+  size_t patterncount;
+  int independent;
+  struct pcre2_finder_stats** stats;
+  size_t* statscount;
+#ifdef PCRE2_FINDER_THREADS
+  pthread_mutex_t statslock;
+#endif
+};
+
+static int add_tree_file (void* callbackdata, const char* path, unsigned long long filesize)
+{
+  struct tree_pool_struct* pool = (struct tree_pool_struct*)callbackdata;
+  struct tree_file_struct* files;
+  if (pool->filecount == pool->filealloc) {
+    if ((files = (struct tree_file_struct*)realloc(pool->files, (pool->filealloc ? pool->filealloc * 2 : 256) * sizeof(struct tree_file_struct))) == NULL)
+      return 2;
+    pool->files = files;
+    pool->filealloc = (pool->filealloc ? pool->filealloc * 2 : 256);
+  }
+  if ((pool->files[pool->filecount].path = strdup(path)) == NULL)
+    return 2;
+  pool->files[pool->filecount].size = filesize;
+  pool->filecount++;
   return 0;
 }
 
+static int compare_tree_files (const void* a, const void* b)
+{
+  return strcmp(((const struct tree_file_struct*)a)->path, ((const struct tree_file_struct*)b)->path);
+}
+
+static struct tree_item_struct* take_tree_item (struct tree_worker_struct* worker)
+{
+  struct tree_pool_struct* pool = worker->pool;
+  struct tree_worker_struct* victim;
+  struct tree_item_struct* item = NULL;
+  unsigned int i;
+  //take the most recently queued item of this worker, or steal the oldest item of another worker
+  for (i = 0; i < pool->workercount && !item; i++) {
+    victim = &pool->workers[(worker - pool->workers + i) % pool->workercount];
+#ifdef PCRE2_FINDER_THREADS
+    pthread_mutex_lock(&victim->queuelock);
+#endif
+    if (victim->queuehead < victim->queuetail) {
+      if (victim == worker)
+        item = &pool->items[victim->queue[--victim->queuetail]];
+      else
+        item = &pool->items[victim->queue[victim->queuehead++]];
+    }
+#ifdef PCRE2_FINDER_THREADS
+    pthread_mutex_unlock(&victim->queuelock);
+#endif
+  }
+  return item;
+}
+
+static void* count_tree_items (void* arg)
+{
+  struct tree_worker_struct* worker = (struct tree_worker_struct*)arg;
+  struct tree_pool_struct* pool = worker->pool;
+  struct tree_item_struct* item;
+  while ((item = take_tree_item(worker)) != NULL) {
+    //each item is searched by a new stream sharing the compiled patterns and has its own counts
+    if ((item->range.stream = pcre2_finder_create_stream(pool->finder)) == NULL) {
+      item->range.status = 2;
+      continue;
+    }
+    worker->countdata.patterncounts = item->range.patterncounts;
+    pcre2_finder_set_user_data(item->range.stream, &worker->countdata);
+    pcre2_finder_set_match_batch(item->range.stream, worker->countdata.matches, MATCHBATCHSIZE, when_found_batch, &worker->countdata);
+    if ((pool->independent ? pcre2_finder_open_independent(item->range.stream) : pcre2_finder_open(item->range.stream, pcre2_finder_output_to_null, NULL)) != 0) {
+      pcre2_finder_cleanup(item->range.stream);
+      item->range.stream = NULL;
+      item->range.status = 2;
+      continue;
+    }
+    item->range.status = count_range(pool->files[item->fileindex].path, worker->buf, &item->range, pool->patterncount);
+    //streams of split files are kept to continue them into the next item (see stitch_range())
+    if (pool->files[item->fileindex].itemcount > 1)
+      continue;
+    if (pool->stats) {
+#ifdef PCRE2_FINDER_THREADS
+      pthread_mutex_lock(&pool->statslock);
+#endif
+      if (collect_stats(item->range.stream, pool->stats, pool->statscount) != 0 && !item->range.status)
+        item->range.status = 2;
+#ifdef PCRE2_FINDER_THREADS
+      pthread_mutex_unlock(&pool->statslock);
+#endif
+    }
+    pcre2_finder_cleanup(item->range.stream);
+    item->range.stream = NULL;
+  }
+  return NULL;
+}
+
+static int count_tree (const char** paths, size_t pathcount, unsigned int workercount, struct pattern_struct* patterns, size_t patterncount, int independent, int perfile, size_t* patterncounts, struct pcre2_finder_stats** stats, size_t* statscount, const char* cachefile)
+{
+  struct tree_pool_struct pool;
+  struct tree_worker_struct* worker;
+  struct range_struct* owner;
+  size_t* filecounts;
+  size_t* synccounts;
+  size_t synccount = 0;
+  size_t maxmatchlen;
+  unsigned long long segmentcount;
+  unsigned long long j;
+#ifdef PCRE2_FINDER_THREADS
+  unsigned int started;
+#endif
+  size_t i;
+  size_t k;
+  int result = 0;
+  int status;
+  pool.files = NULL;
+  pool.filecount = 0;
+  pool.filealloc = 0;
+  pool.items = NULL;
+  pool.itemcount = 0;
+  pool.workers = NULL;
+  pool.patterncount = patterncount;
+  pool.independent = independent;
+  pool.stats = stats;
+  pool.statscount = statscount;
+  //find all files and sort them so the results don't depend on the order of the directory entries
+  for (i = 0; i < pathcount; i++) {
+    if ((status = dir_scanner_scan(paths[i], add_tree_file, &pool)) > 0) {
+      result = status;
+      break;
+    }
+    if (status != 0) {
+      fprintf(stderr, "Error reading directory: %s\n", paths[i]);
+      result = 5;
+    }
+  }
+  if (result != 0 && result != 5) {
+    for (i = 0; i < pool.filecount; i++)
+      free(pool.files[i].path);
+    free(pool.files);
+    return result;
+  }
+  if (pool.filecount > 1)
+    qsort(pool.files, pool.filecount, sizeof(struct tree_file_struct), compare_tree_files);
+  //compile the patterns once
+  if ((pool.finder = create_finder(patterns, patterncount, 0, (stats != NULL), independent, NULL, cachefile)) == NULL) {
+    for (i = 0; i < pool.filecount; i++)
+      free(pool.files[i].path);
+    free(pool.files);
+    return 4;
+  }
+  //split large files in segments so they are spread over the workers (only if the maximum match length is bounded, so partial matches end soon enough to get the segments in step)
+  maxmatchlen = pcre2_finder_get_max_match_length(pool.finder);
+  for (i = 0; i < pool.filecount; i++) {
+    pool.files[i].firstitem = pool.itemcount;
+    pool.files[i].itemcount = (maxmatchlen && pool.files[i].size >= 2 * TREESEGMENTSIZE ? (size_t)(pool.files[i].size / TREESEGMENTSIZE) : 1);
+    pool.itemcount += pool.files[i].itemcount;
+    synccount += pool.files[i].itemcount - 1;
+  }
+  filecounts = NULL;
+  synccounts = NULL;
+  if ((pool.items = (struct tree_item_struct*)malloc((pool.itemcount ? pool.itemcount : 1) * sizeof(struct tree_item_struct))) == NULL || (filecounts = (size_t*)calloc(pool.itemcount * (patterncount ? patterncount : 1) + 1, sizeof(size_t))) == NULL || (synccount && (synccounts = (size_t*)malloc(synccount * SEGMENTSYNCPOINTS * (patterncount ? patterncount : 1) * sizeof(size_t))) == NULL)) {
+    free(filecounts);
+    free(pool.items);
+    result = 2;
+  } else {
+    synccount = 0;
+    for (i = 0; i < pool.filecount; i++) {
+      segmentcount = pool.files[i].itemcount;
+      for (j = 0; j < segmentcount; j++) {
+        struct tree_item_struct* item = &pool.items[pool.files[i].firstitem + j];
+        item->fileindex = i;
+        item->range.start = pool.files[i].size * j / segmentcount;
+        item->range.end = (j + 1 == segmentcount ? (unsigned long long)-1 : pool.files[i].size * (j + 1) / segmentcount);
+        item->range.last = (j + 1 == segmentcount);
+        item->range.status = 0;
+        item->range.patterncounts = filecounts + (pool.files[i].firstitem + j) * patterncount;
+        item->range.stream = NULL;
+        item->range.synccounts = NULL;
+        item->range.synccount = 0;
+        if (j > 0)
+          item->range.synccounts = synccounts + synccount++ * SEGMENTSYNCPOINTS * patterncount;
+      }
+    }
+    //queue the items over the workers in turn, each worker takes its own items first and then steals from the others
+#ifdef PCRE2_FINDER_THREADS
+    if (workercount > pool.itemcount)
+      workercount = (unsigned int)(pool.itemcount ? pool.itemcount : 1);
+#else
+    workercount = 1;
+#endif
+    pool.workercount = 0;
+    if ((pool.workers = (struct tree_worker_struct*)malloc(workercount * sizeof(struct tree_worker_struct))) == NULL)
+      result = 2;
+    while (pool.workers && pool.workercount < workercount) {
+      worker = &pool.workers[pool.workercount];
+      worker->pool = &pool;
+      worker->queuehead = 0;
+      worker->queuetail = 0;
+      worker->countdata.count = 0;
+      worker->countdata.index = NULL;
+      worker->countdata.indexerror = 0;
+      worker->countdata.maxcount = 0;
+      worker->countdata.found = 0;
+      worker->buf = NULL;
+      if ((worker->queue = (size_t*)malloc((pool.itemcount / workercount + 1) * sizeof(size_t))) == NULL || (worker->buf = (char*)malloc(SEGMENTBUFFERSIZE)) == NULL) {
+        free(worker->queue);
+        result = 2;
+        break;
+      }
+      for (k = pool.workercount; k < pool.itemcount; k += workercount)
+        worker->queue[worker->queuetail++] = k;
+#ifdef PCRE2_FINDER_THREADS
+      pthread_mutex_init(&worker->queuelock, NULL);
+#endif
+      pool.workercount++;
+    }
+    if (result == 0 || result == 5) {
+#ifdef PCRE2_FINDER_THREADS
+      pthread_mutex_init(&pool.statslock, NULL);
+      for (started = 1; started < pool.workercount; started++) {
+        if (pthread_create(&pool.workers[started].thread, NULL, count_tree_items, &pool.workers[started]) != 0)
+          break;
+      }
+      //this thread is the first worker, items of workers that couldn't be started are stolen
+      count_tree_items(&pool.workers[0]);
+      while (started-- > 1)
+        pthread_join(pool.workers[started].thread, NULL);
+      pthread_mutex_destroy(&pool.statslock);
+#else
+      count_tree_items(&pool.workers[0]);
+#endif
+      //merge the counts of each file in the sorted order, continuing the search of each item of a split file into the next one until they are in step
+      for (i = 0; i < pool.filecount; i++) {
+        size_t filecount = 0;
+        status = 0;
+        for (k = pool.files[i].firstitem; k < pool.files[i].firstitem + pool.files[i].itemcount; k++) {
+          if (pool.items[k].range.status && !status)
+            status = pool.items[k].range.status;
+        }
+        owner = &pool.items[pool.files[i].firstitem].range;
+        for (k = pool.files[i].firstitem + 1; k < pool.files[i].firstitem + pool.files[i].itemcount && !status; k++)
+          status = stitch_range(pool.files[i].path, pool.workers[0].buf, &owner, &pool.items[k].range, patterncount);
+        for (k = pool.files[i].firstitem; k < pool.files[i].firstitem + pool.files[i].itemcount; k++) {
+          for (j = 0; j < patterncount; j++) {
+            patterncounts[j] += pool.items[k].range.patterncounts[j];
+            filecount += pool.items[k].range.patterncounts[j];
+          }
+          if (pool.items[k].range.stream) {
+            if (stats && collect_stats(pool.items[k].range.stream, stats, statscount) != 0 && !status)
+              status = 2;
+            pcre2_finder_cleanup(pool.items[k].range.stream);
+          }
+        }
+        if (status == 5)
+          fprintf(stderr, "Error reading file: %s\n", pool.files[i].path);
+        if (status && (!result || result == 5))
+          result = status;
+        if (perfile)
+          printf("%s: %lu matches found\n", pool.files[i].path, (unsigned long)filecount);
+      }
+    }
+    while (pool.workercount-- > 0) {
+#ifdef PCRE2_FINDER_THREADS
+      pthread_mutex_destroy(&pool.workers[pool.workercount].queuelock);
+#endif
+      free(pool.workers[pool.workercount].queue);
+      free(pool.workers[pool.workercount].buf);
+    }
+    free(pool.workers);
+    free(synccounts);
+    free(filecounts);
+    free(pool.items);
+  }
+  for (i = 0; i < pool.filecount; i++)
+    free(pool.files[i].path);
+  free(pool.files);
+  pcre2_finder_cleanup(pool.finder);
+  return result;
+}
+
+static unsigned int get_processor_count ()
+{
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (info.dwNumberOfProcessors > 0 ? (unsigned int)info.dwNumberOfProcessors : 1);
+#elif defined(_SC_NPROCESSORS_ONLN)
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count > 0 ? (unsigned int)count : 1);
+#else
+  return 1;
+#endif
+}
+
 void show_help()
 {
   printf(
-    "Usage:  pcre2_finder_count [[-?|-h] -c] [-i] [-f file] [-t text] [-p <pattern>] <pattern> ...\n" \
+    "Usage:  pcre2_finder_count [[-?|-h] -c] [-i] [-e engine] [-s|-l] [-w threads] [-j threads] [-m count] [-q] [-f file] [-r path] [-b bytes] [-t text] [--match-limit n] [--depth-limit n] [--heap-limit kb] [--time-limit ms] [--limit-policy policy] [--independent] [--per-file] [--index file] [--stats] [--cache file] [-p <pattern>] <pattern> ...\n" \
     "Parameters:\n" \
     "  -? | -h     \tshow help\n" \
     "  -c          \tcase sensitive matching for next pattern(s) (default)\n" \
     "  -i          \tcase insensitive matching for next pattern(s)\n" \
-    "  -f file     \tinput file (default is to use standard input)\n" \
-    "  -t text     \tuse text as search data (overrides -f)\n" \
+    "  -e engine   \tmatching engine for next pattern(s): dfa (default) or jit\n" \
+    "  -s          \tsearch next pattern(s) simultaneously in a single pass\n" \
+    "  -l          \tsearch next pattern(s) layered, one pass per pattern (default)\n" \
+    "  -w threads  \tsearch layers on up to the specified number of worker threads\n" \
+    "  -j threads  \tsplit large input file in segments counted on the specified number of threads\n" \
+    "              \t(only if all patterns have a bounded match length, overrides -w)\n" \
+    "  -m count    \tstop reading input after the specified number of matches (searches on this thread, not with -r)\n" \
+    "  -q          \tquiet, only stop at the first match and exit with status 0 if found or 7 if not found (implies -m 1)\n" \
+    "  -f file     \tinput file (default is to use standard input), can be repeated to count matches in\n" \
+    "              \tmultiple files with several reads in flight (-w and -j don't apply to multiple files)\n" \
+    "  -r path     \tcount matches in all files below path (can be repeated, files given with -f are included),\n" \
+    "              \tsearched on -j threads (default is the number of processors) with large files split in segments\n" \
+    "  -t text     \tuse text as search data (overrides -f and -r)\n" \
+    "  -b bytes    \tread buffer size for input that isn't a regular file or for multiple files (default is 1 MB)\n" \
+    "  --match-limit n\tmaximum number of matching steps per search for next pattern(s) (default is the PCRE2 default)\n" \
+    "  --depth-limit n\tmaximum backtracking depth per search for next pattern(s) (default is the PCRE2 default)\n" \
+    "  --heap-limit kb\tmaximum heap memory per search in KB for next pattern(s) (default is the PCRE2 default)\n" \
+    "  --time-limit ms\tmaximum time each of the next pattern(s) spends on each block of input (default is no limit)\n" \
+    "  --limit-policy policy\twhen next pattern(s) hit a limit: fail (default) or skip the rest of the block as non-matching\n" \
+    "  --independent\tcount matches of each pattern in the input instead of in what previous patterns didn't match\n" \
+    "  --per-file  \tprint the number of matches in each file found with -r\n" \
+    "  --index file\twrite the offset, length and pattern number of each match sorted by offset to a binary\n" \
+    "              \tindex file (implies --independent and searches a single input on this thread)\n" \
+    "  --stats     \tprint statistics of each search pass to standard error\n" \
+    "  --cache file\tload compiled patterns from file, or save them to it if it doesn't match the patterns\n" \
     "  -p pattern  \tpattern to search for (can be used if pattern starts with \"-\")\n" \
     "  pattern     \tpattern to search for\n" \
     "Version: " PCRE2_FINDER_VERSION_STRING "\n" \
@@ -40,22 +903,48 @@ int main (int argc, char** argv)
 {
   struct pcre2_finder* finder;
   struct count_data_struct countdata;
+  struct pattern_struct* patternlist;
   int flags = PCRE2_DFA_SHORTEST;
+  int engine = PCRE2_FINDER_ENGINE_DFA;
+  int mode = PCRE2_FINDER_MODE_LAYERED;
+  uint32_t matchlimit = 0;
+  uint32_t depthlimit = 0;
+  uint32_t heaplimit = 0;
+  unsigned long long timelimit = 0;
+  int limitpolicy = PCRE2_FINDER_LIMIT_FAIL;
   const char* srcfile = NULL;
+  const char** srcfiles = NULL;
+  size_t srcfilecount = 0;
+  const char** treepaths = NULL;
+  size_t treepathcount = 0;
+  int perfile = 0;
+  int counted = 0;
   const char* srctext = NULL;
   size_t* patterncounts = NULL;
   size_t patterns = 0;
+  unsigned int threads = 0;
+  unsigned int segments = 0;
+  size_t buffersize = INPUT_READER_BUFFER_SIZE;
+  int showstats = 0;
+  int independent = 0;
+  int exitstatus = 0;
+  const char* cachefile = NULL;
+  const char* indexfile = NULL;
+  size_t maxcount = 0;
+  int quiet = 0;
+  struct pcre2_finder_stats* stats = NULL;
+  size_t statscount = 0;
   //initialize
-  if ((patterncounts = (size_t*)malloc((argc - 1) * sizeof(size_t))) == NULL) {
+  if ((patterncounts = (size_t*)malloc((argc - 1) * sizeof(size_t))) == NULL || (patternlist = (struct pattern_struct*)malloc((argc - 1) * sizeof(struct pattern_struct))) == NULL || (srcfiles = (const char**)malloc((argc - 1) * sizeof(const char*))) == NULL || (treepaths = (const char**)malloc((argc - 1) * 2 * sizeof(const char*))) == NULL) {
     fprintf(stderr, "Memory allocation error\n");
     return 2;
   }
   countdata.count = 0;
   countdata.patterncounts = patterncounts;
-  if ((finder = pcre2_finder_initialize()) == NULL) {
-    fprintf(stderr, "Error in pcre2_finder_initialize()\n");
-    return 3;
-  }
+  countdata.index = NULL;
+  countdata.indexerror = 0;
+  countdata.maxcount = 0;
+  countdata.found = 0;
   //process command line parameters
   {
     int i = 0;
@@ -84,6 +973,62 @@ int main (int argc, char** argv)
             else
               flags |= PCRE2_CASELESS;
             break;
+          case 'e' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else if (strcmp(param, "dfa") == 0)
+              engine = PCRE2_FINDER_ENGINE_DFA;
+            else if (strcmp(param, "jit") == 0)
+              engine = PCRE2_FINDER_ENGINE_JIT;
+            else
+              paramerror++;
+            break;
+          case 's' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              mode = PCRE2_FINDER_MODE_SIMULTANEOUS;
+            break;
+          case 'l' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              mode = PCRE2_FINDER_MODE_LAYERED;
+            break;
+          case 'w' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || (threads = strtoul(param, NULL, 10)) == 0)
+              paramerror++;
+            break;
+          case 'j' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || (segments = strtoul(param, NULL, 10)) == 0)
+              paramerror++;
+            break;
+          case 'm' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || (maxcount = strtoul(param, NULL, 10)) == 0)
+              paramerror++;
+            break;
+          case 'q' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              quiet = 1;
+            break;
           case 'f' :
             if (argv[i][2])
               param = argv[i] + 2;
@@ -92,7 +1037,25 @@ int main (int argc, char** argv)
             if (!param)
               paramerror++;
             else
-              srcfile = param;
+              srcfile = srcfiles[srcfilecount++] = param;
+            break;
+          case 'r' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else
+              treepaths[treepathcount++] = param;
+            break;
+          case 'b' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || (buffersize = strtoul(param, NULL, 10)) == 0)
+              paramerror++;
             break;
           case 't' :
             if (argv[i][2])
@@ -113,8 +1076,48 @@ int main (int argc, char** argv)
               paramerror++;
             else {
               patterncounts[patterns] = 0;
-              pcre2_finder_add_expr(finder, param, flags, when_found, &countdata, patterns++);
+              patternlist[patterns].expr = param;
+              patternlist[patterns].flags = flags;
+              patternlist[patterns].engine = engine;
+              patternlist[patterns].mode = mode;
+              patternlist[patterns].matchlimit = matchlimit;
+              patternlist[patterns].depthlimit = depthlimit;
+              patternlist[patterns].heaplimit = heaplimit;
+              patternlist[patterns].timelimit = timelimit;
+              patternlist[patterns].limitpolicy = limitpolicy;
+              patterns++;
+            }
+            break;
+          case '-' :
+            if (strcmp(argv[i] + 2, "stats") == 0)
+              showstats = 1;
+            else if (strcmp(argv[i] + 2, "independent") == 0)
+              independent = 1;
+            else if (strcmp(argv[i] + 2, "per-file") == 0)
+              perfile = 1;
+            else if (strcmp(argv[i] + 2, "cache") == 0 && i + 1 < argc && argv[i + 1])
+              cachefile = argv[++i];
+            else if (strcmp(argv[i] + 2, "index") == 0 && i + 1 < argc && argv[i + 1])
+              indexfile = argv[++i];
+            else if (strcmp(argv[i] + 2, "match-limit") == 0 && i + 1 < argc && argv[i + 1])
+              matchlimit = strtoul(argv[++i], NULL, 10);
+            else if (strcmp(argv[i] + 2, "depth-limit") == 0 && i + 1 < argc && argv[i + 1])
+              depthlimit = strtoul(argv[++i], NULL, 10);
+            else if (strcmp(argv[i] + 2, "heap-limit") == 0 && i + 1 < argc && argv[i + 1])
+              heaplimit = strtoul(argv[++i], NULL, 10);
+            else if (strcmp(argv[i] + 2, "time-limit") == 0 && i + 1 < argc && argv[i + 1])
+              timelimit = strtoull(argv[++i], NULL, 10) * 1000000ULL;
+            else if (strcmp(argv[i] + 2, "limit-policy") == 0 && i + 1 < argc && argv[i + 1]) {
+              param = argv[++i];
+              if (strcmp(param, "fail") == 0)
+                limitpolicy = PCRE2_FINDER_LIMIT_FAIL;
+              else if (strcmp(param, "skip") == 0)
+                limitpolicy = PCRE2_FINDER_LIMIT_SKIP;
+              else
+                paramerror++;
             }
+            else
+              paramerror++;
             break;
           default :
             paramerror++;
@@ -122,9 +1125,26 @@ int main (int argc, char** argv)
         }
       } else {
         patterncounts[patterns] = 0;
-        pcre2_finder_add_expr(finder, argv[i], flags, when_found, &countdata, patterns++);
+        patternlist[patterns].expr = argv[i];
+        patternlist[patterns].flags = flags;
+        patternlist[patterns].engine = engine;
+        patternlist[patterns].mode = mode;
+        patternlist[patterns].matchlimit = matchlimit;
+        patternlist[patterns].depthlimit = depthlimit;
+        patternlist[patterns].heaplimit = heaplimit;
+        patternlist[patterns].timelimit = timelimit;
+        patternlist[patterns].limitpolicy = limitpolicy;
+        patterns++;
       }
     }
+    //offsets are only meaningful within a single input
+    if (indexfile && !srctext && (srcfilecount > 1 || treepathcount > 0))
+      paramerror++;
+    //the number of matches is only limited when all matches are counted on this thread
+    if (quiet && !maxcount)
+      maxcount = 1;
+    if (maxcount && !srctext && treepathcount > 0)
+      paramerror++;
     if (paramerror || argc <= 1) {
       if (paramerror)
         fprintf(stderr, "Invalid command line parameters\n");
@@ -132,49 +1152,136 @@ int main (int argc, char** argv)
       return 1;
     }
   }
-  //prepare finder for searching
-  if (pcre2_finder_open(finder, pcre2_finder_output_to_null, NULL) != 0) {
-    fprintf(stderr, "Error in pcre2_finder_open()\n");
-    pcre2_finder_cleanup(finder);
-    return 4;
+  //every expression searches the input on this thread so the offsets of all matches are positions in the input
+  if (indexfile) {
+    if ((countdata.index = match_index_create()) == NULL) {
+      fprintf(stderr, "Memory allocation error\n");
+      return 2;
+    }
+    independent = 1;
+    threads = 0;
+    segments = 0;
+  }
+  //count matches on this thread to stop as soon as the maximum number of matches is reached
+  if (maxcount) {
+    countdata.maxcount = maxcount;
+    threads = 0;
+    segments = 0;
   }
-  //process search data
-  if (srctext) {
-    //process supplied text
-    if (pcre2_finder_process(finder, srctext, strlen(srctext)) < 0) {
-      fprintf(stderr, "Error in pcre2_finder_process()\n");
+  //process all files below the given paths on a pool of threads
+  if (treepathcount > 0 && !srctext) {
+    size_t i;
+    for (i = 0; i < srcfilecount; i++)
+      treepaths[treepathcount++] = srcfiles[i];
+    //files that can't be read are reported and the matches in the other files are still shown
+    if ((exitstatus = count_tree(treepaths, treepathcount, (segments ? segments : get_processor_count()), patternlist, patterns, independent, perfile, patterncounts, (showstats ? &stats : NULL), &statscount, cachefile)) != 0 && exitstatus != 5) {
+      fprintf(stderr, (exitstatus == 4 ? "Error in pcre2_finder_open()\n" : exitstatus == 6 ? "Error in pcre2_finder_process()\n" : "Memory allocation error\n"));
+      free(stats);
+      free(treepaths);
+      free(srcfiles);
+      free(patterncounts);
+      free(patternlist);
+      return exitstatus;
+    }
+    counted = 1;
+  //process multiple files, each with its own stream
+  } else if (srcfilecount > 1 && !srctext) {
+    //files that can't be read are reported and the matches in the other files are still shown
+    if ((exitstatus = count_files(srcfiles, srcfilecount, buffersize, patternlist, patterns, independent, maxcount, patterncounts, (showstats ? &stats : NULL), &statscount, cachefile)) != 0 && exitstatus != 5) {
+      fprintf(stderr, (exitstatus == 4 ? "Error in pcre2_finder_open()\n" : "Memory allocation error\n"));
+      free(stats);
+      free(treepaths);
+      free(srcfiles);
+      free(patterncounts);
+      free(patternlist);
+      return exitstatus;
     }
+    counted = 1;
+  //process large file in segments on multiple threads
+  } else if (segments > 1 && srcfile && !srctext) {
+#ifdef PCRE2_FINDER_THREADS
+    int status;
+    if ((status = count_segments(srcfile, segments, patternlist, patterns, independent, patterncounts, (showstats ? &stats : NULL), &statscount, cachefile)) > 0) {
+      fprintf(stderr, "Error counting file in segments: %s\n", srcfile);
+      free(stats);
+      free(treepaths);
+      free(srcfiles);
+      free(patterncounts);
+      free(patternlist);
+      return status;
+    }
+    if (status < 0)
+      segments = 0;
+#else
+    segments = 0;
+#endif
+    if (!segments)
+      fprintf(stderr, "Input can't be split in segments, counting sequentially\n");
   } else {
-    //process file (or standard input)
-    FILE* src;
-    char buf[READBUFFERSIZE];
-    size_t buflen;
-    if (!srcfile) {
-      src = stdin;
+    segments = 0;
+  }
+  if (!segments && !counted) {
+    //prepare finder for searching
+    if ((finder = create_finder(patternlist, patterns, threads, showstats, independent, &countdata, cachefile)) == NULL) {
+      fprintf(stderr, "Error in pcre2_finder_open()\n");
+      return 4;
+    }
+    //process search data
+    if (srctext) {
+      //process supplied text
+      if (pcre2_finder_process(finder, srctext, strlen(srctext)) < 0) {
+        fprintf(stderr, "Error in pcre2_finder_process()\n");
+      }
     } else {
-      if ((src = fopen(srcfile, "rb")) == NULL) {
-        fprintf(stderr, "Error opening file: %s\n", srcfile);
+      //process file (memory mapped if possible) or standard input
+      if (input_reader_read(srcfile, buffersize, process_input, finder) < 0) {
+        fprintf(stderr, "Error reading file: %s\n", (srcfile ? srcfile : "(standard input)"));
         pcre2_finder_cleanup(finder);
         return 5;
       }
     }
-    while ((buflen = fread(buf, 1, READBUFFERSIZE, src)) > 0) {
-      if (pcre2_finder_process(finder, buf, buflen) < 0) {
-        fprintf(stderr, "Error in pcre2_finder_process()\n");
-      }
+    if (pcre2_finder_close(finder) < 0) {
+      fprintf(stderr, "Error in pcre2_finder_close()\n");
     }
-    fclose(src);
+    if (showstats && collect_stats(finder, &stats, &statscount) != 0) {
+      fprintf(stderr, "Memory allocation error\n");
+    }
+    pcre2_finder_cleanup(finder);
   }
-  pcre2_finder_close(finder);
-  //show results
-  printf("%lu matches found\n", (unsigned long)countdata.count);
+  //write the index of all matches
+  if (countdata.index) {
+    if (countdata.indexerror) {
+      fprintf(stderr, "Memory allocation error\n");
+      exitstatus = 2;
+    } else if (match_index_write(countdata.index, indexfile) != 0) {
+      fprintf(stderr, "Error writing index file: %s\n", indexfile);
+      exitstatus = 3;
+    }
+    match_index_free(countdata.index);
+  }
+  //show results (each pattern is only counted by one worker thread, so the total is added up afterwards)
   {
     size_t i;
+    for (i = 0; i < patterns; i++)
+      countdata.count += patterncounts[i];
+  }
+  if (quiet) {
+    //only report whether a match was found with the exit status
+    if (!countdata.count && !exitstatus)
+      exitstatus = 7;
+  } else {
+    size_t i;
+    printf("%lu matches found\n", (unsigned long)countdata.count);
     for (i = 0; i < patterns; i++)
       printf("pattern %lu found %lu times\n", (unsigned long)i + 1, (unsigned long)patterncounts[i]);
   }
+  if (stats)
+    show_stats(stats, statscount);
   //clean up
+  free(stats);
+  free(treepaths);
+  free(srcfiles);
   free(patterncounts);
-  pcre2_finder_cleanup(finder);
-  return 0;
+  free(patternlist);
+  return exitstatus;
 }
@@ -1,48 +1,132 @@
 #include "pcre2_finder.h"
+#include "input_reader.h"
+#include "replace_template.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
 
-#define READBUFFERSIZE 128
-
 struct replace_data_struct {
   size_t count;
   size_t* patterncounts;
-  const char** patternreplacements;
+  struct replace_template_struct** patterntemplates;
 };
 
 static int when_found (struct pcre2_finder* finder, const char* data, size_t datalen, void* callbackdata, int matchid)
 {
   struct replace_data_struct* replacedata = (struct replace_data_struct*)callbackdata;
-  replacedata->count++;
   replacedata->patterncounts[matchid]++;
-  pcre2_finder_output(finder, replacedata->patternreplacements[matchid], strlen(replacedata->patternreplacements[matchid]));
+  replace_template_output(replacedata->patterntemplates[matchid], finder, data, datalen);
   return 0;
 }
 
-static size_t flushsearchdata (void* callbackdata, const char* data, size_t datalen)
+struct pattern_struct {
+  const char* expr;
+  int flags;
+  int engine;
+  int mode;
+};
+
+static unsigned long long hash_data (unsigned long long hash, const char* data, size_t datalen)
+{
+  //FNV-1a
+  while (datalen--)
+    hash = (hash ^ (unsigned char)*data++) * 1099511628211ULL;
+  return hash;
+}
+
+static struct pcre2_finder* create_finder (struct pattern_struct* patterns, size_t patterncount, struct replace_data_struct* replacedata, const char* cachefile)
+{
+  struct pcre2_finder* finder;
+  unsigned long long key = 14695981039346656037ULL;
+  char options[64];
+  size_t i;
+  if ((finder = pcre2_finder_initialize()) == NULL)
+    return NULL;
+  //load compiled patterns from the cache file, or compile them and save them for next time (replacements aren't cached)
+  if (cachefile) {
+    for (i = 0; i < patterncount; i++) {
+      key = hash_data(key, patterns[i].expr, strlen(patterns[i].expr) + 1);
+      key = hash_data(key, options, sprintf(options, "%i %i %i\n", patterns[i].flags, patterns[i].engine, patterns[i].mode));
+    }
+    if (pcre2_finder_load(finder, cachefile, key, when_found, replacedata) == 0)
+      return finder;
+    pcre2_finder_cleanup(finder);
+    if ((finder = pcre2_finder_initialize()) == NULL)
+      return NULL;
+  }
+  for (i = 0; i < patterncount; i++) {
+    pcre2_finder_set_engine(finder, patterns[i].engine);
+    pcre2_finder_set_mode(finder, patterns[i].mode);
+    pcre2_finder_add_expr(finder, patterns[i].expr, patterns[i].flags, when_found, replacedata, i);
+  }
+  if (cachefile && pcre2_finder_save(finder, cachefile, key) != 0)
+    fprintf(stderr, "Error writing cache file: %s\n", cachefile);
+  return finder;
+}
+
+struct input_data_struct {
+  struct pcre2_finder* finder;
+  struct pcre2_finder_writev_sink* sink;
+  unsigned int threads;
+};
+
+static int process_input (void* callbackdata, const char* data, size_t datalen)
 {
-  if (datalen)
-    fprintf((FILE*)callbackdata, "%.*s", (int)datalen, data);
+  struct input_data_struct* inputdata = (struct input_data_struct*)callbackdata;
+  if (pcre2_finder_process(inputdata->finder, data, datalen) < 0) {
+    fprintf(stderr, "Error in pcre2_finder_process()\n");
+  }
+  //data must be written before it is overwritten or unmapped (worker threads copy it and write the output themselves)
+  if (inputdata->threads <= 1)
+    pcre2_finder_writev_sink_flush(inputdata->sink);
   return 0;
 }
 
+static void show_stats (struct pcre2_finder* finder)
+{
+  struct pcre2_finder_stats* stats;
+  size_t count;
+  size_t i;
+  count = pcre2_finder_get_stats(finder, NULL, 0);
+  if ((stats = (struct pcre2_finder_stats*)malloc((count ? count : 1) * sizeof(struct pcre2_finder_stats))) == NULL) {
+    fprintf(stderr, "Memory allocation error\n");
+    return;
+  }
+  pcre2_finder_get_stats(finder, stats, count);
+  for (i = 0; i < count; i++) {
+    if (stats[i].exprcount > 1)
+      fprintf(stderr, "patterns %i-%i:", stats[i].matchid + 1, stats[i].matchid + (int)stats[i].exprcount);
+    else
+      fprintf(stderr, "pattern %i:", stats[i].matchid + 1);
+    fprintf(stderr, " %llu bytes in, %llu bytes out, %llu matches, %llu searches taking %.3f ms, %llu partial matches carried (largest %lu bytes)\n", stats[i].bytesin, stats[i].bytesout, stats[i].matches, stats[i].searches, (double)stats[i].searchtime / 1000000, stats[i].partialcarries, (unsigned long)stats[i].partialpeak);
+  }
+  free(stats);
+}
+
 void show_help()
 {
   printf(
-    "Usage:  pcre2_finder_replace [-?|-h] [-c] [-i] [-f file] [-t text] [-p <pattern> <replacement>] <pattern> <replacement> ...\n" \
+    "Usage:  pcre2_finder_replace [-?|-h] [-c] [-i] [-e engine] [-s|-l] [-w threads] [-f file] [-b bytes] [-t text] [--stats] [--cache file] [-p <pattern> <replacement>] <pattern> <replacement> ...\n" \
     "Parameters:\n" \
     "  -? | -h     \tshow help\n" \
     "  -c          \tcase sensitive matching for next pattern(s) (default)\n" \
     "  -i          \tcase insensitive matching for next pattern(s)\n" \
+    "  -e engine   \tmatching engine for next pattern(s): dfa (default) or jit\n" \
+    "  -s          \tsearch next pattern(s) simultaneously in a single pass\n" \
+    "  -l          \tsearch next pattern(s) layered, one pass per pattern (default)\n" \
+    "  -w threads  \tsearch layers on up to the specified number of worker threads\n" \
     "  -f file     \tinput file (default is to use standard input)\n" \
     "  -o file     \toutput file (default is to use standard output)\n" \
     "  -v          \tprint number of replacements done\n" \
     "  -t text     \tuse text as search data (overrides -f)\n" \
+    "  -b bytes    \tread buffer size for input that isn't a regular file (default is 1 MB)\n" \
+    "  --stats     \tprint statistics of each search pass to standard error\n" \
+    "  --cache file\tload compiled patterns from file, or save them to it if it doesn't match the patterns\n" \
     "  -p          \tnext 2 parameters are pattern and replacement (can be used if pattern or replacement starts with \"-\")\n" \
     "  pattern     \tpattern to search for\n" \
-    "  replacement \treplacement to replace pattern with\n" \
+    "  replacement \treplacement to replace pattern with ($1 or ${1} for a group, ${name} for a named group, $0 for the match, $$ for $)\n" \
+    "              \t(groups are found by matching the pattern again on the matched text only, so a group that depends on lookbehind or lookahead outside of it is empty)\n" \
     "Version: " PCRE2_FINDER_VERSION_STRING "\n" \
     "\n"
   );
@@ -52,31 +136,37 @@ int main (int argc, char** argv)
 {
   struct pcre2_finder* finder;
   struct replace_data_struct replacedata;
+  struct input_data_struct inputdata;
   FILE* dst;
+  struct pcre2_finder_writev_sink* sink;
+  struct pattern_struct* patternlist;
   int flags = PCRE2_DFA_SHORTEST;
+  int engine = PCRE2_FINDER_ENGINE_DFA;
+  int mode = PCRE2_FINDER_MODE_LAYERED;
   int verbose = 0;
+  int showstats = 0;
+  const char* cachefile = NULL;
   const char* srcfile = NULL;
   const char* dstfile = NULL;
   const char* srctext = NULL;
   size_t* patterncounts = NULL;
   const char** patternreplacements = NULL;
+  struct replace_template_struct** patterntemplates = NULL;
   size_t patterns = 0;
+  unsigned int threads = 0;
+  size_t buffersize = INPUT_READER_BUFFER_SIZE;
   //initialize
   if ((patterncounts = (size_t*)malloc((argc - 1) * sizeof(size_t))) == NULL) {
     fprintf(stderr, "Memory allocation error\n");
     return 2;
   }
-  if ((patternreplacements = (const char**)malloc((argc - 1) * sizeof(char*))) == NULL) {
+  if ((patternreplacements = (const char**)malloc((argc - 1) * sizeof(char*))) == NULL || (patternlist = (struct pattern_struct*)malloc((argc - 1) * sizeof(struct pattern_struct))) == NULL || (patterntemplates = (struct replace_template_struct**)malloc((argc - 1) * sizeof(struct replace_template_struct*))) == NULL) {
     fprintf(stderr, "Memory allocation error\n");
     return 2;
   }
   replacedata.count = 0;
   replacedata.patterncounts = patterncounts;
-  replacedata.patternreplacements = patternreplacements;
-  if ((finder = pcre2_finder_initialize()) == NULL) {
-    fprintf(stderr, "Error in pcre2_finder_initialize()\n");
-    return 2;
-  }
+  replacedata.patterntemplates = patterntemplates;
   //process command line parameters
   {
     int i = 0;
@@ -105,6 +195,42 @@ int main (int argc, char** argv)
             else
               flags |= PCRE2_CASELESS;
             break;
+          case 'e' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else if (strcmp(param, "dfa") == 0)
+              engine = PCRE2_FINDER_ENGINE_DFA;
+            else if (strcmp(param, "jit") == 0)
+              engine = PCRE2_FINDER_ENGINE_JIT;
+            else
+              paramerror++;
+            break;
+          case 's' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              mode = PCRE2_FINDER_MODE_SIMULTANEOUS;
+            break;
+          case 'l' :
+            if (argv[i][2])
+              paramerror++;
+            else
+              mode = PCRE2_FINDER_MODE_LAYERED;
+            break;
+          case 'w' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param)
+              paramerror++;
+            else if ((threads = strtoul(param, NULL, 10)) == 0)
+              paramerror++;
+            break;
           case 'f' :
             if (argv[i][2])
               param = argv[i] + 2;
@@ -131,6 +257,14 @@ int main (int argc, char** argv)
             else
               verbose = 1;
             break;
+          case 'b' :
+            if (argv[i][2])
+              param = argv[i] + 2;
+            else if (i + 1 < argc && argv[i + 1])
+              param = argv[++i];
+            if (!param || (buffersize = strtoul(param, NULL, 10)) == 0)
+              paramerror++;
+            break;
           case 't' :
             if (argv[i][2])
               param = argv[i] + 2;
@@ -155,10 +289,22 @@ int main (int argc, char** argv)
               else {
                 patterncounts[patterns] = 0;
                 patternreplacements[patterns] = param2;
-                pcre2_finder_add_expr(finder, param, flags, when_found, &replacedata, patterns++);
+                patternlist[patterns].expr = param;
+                patternlist[patterns].flags = flags;
+                patternlist[patterns].engine = engine;
+                patternlist[patterns].mode = mode;
+                patterns++;
               }
               break;
             }
+          case '-' :
+            if (strcmp(argv[i] + 2, "stats") == 0)
+              showstats = 1;
+            else if (strcmp(argv[i] + 2, "cache") == 0 && i + 1 < argc && argv[i + 1])
+              cachefile = argv[++i];
+            else
+              paramerror++;
+            break;
           default :
             paramerror++;
             break;
@@ -166,7 +312,11 @@ int main (int argc, char** argv)
       } else if (i + 1 < argc) {
         patterncounts[patterns] = 0;
         patternreplacements[patterns] = argv[i + 1];
-        pcre2_finder_add_expr(finder, argv[i], flags, when_found, &replacedata, patterns++);
+        patternlist[patterns].expr = argv[i];
+        patternlist[patterns].flags = flags;
+        patternlist[patterns].engine = engine;
+        patternlist[patterns].mode = mode;
+        patterns++;
         i++;
       } else {
         paramerror++;
@@ -180,6 +330,28 @@ int main (int argc, char** argv)
       return 1;
     }
   }
+  //parse replacements
+  {
+    size_t i;
+    for (i = 0; i < patterns; i++) {
+      if ((patterntemplates[i] = replace_template_create(patternreplacements[i], patternlist[i].expr, patternlist[i].flags)) == NULL) {
+        fprintf(stderr, "Invalid replacement for pattern %lu: %s\n", (unsigned long)i + 1, patternreplacements[i]);
+        while (i > 0)
+          replace_template_free(patterntemplates[--i]);
+        return 1;
+      }
+    }
+  }
+  //compile patterns (or load them from the cache file)
+  if ((finder = create_finder(patternlist, patterns, &replacedata, cachefile)) == NULL) {
+    fprintf(stderr, "Error in pcre2_finder_initialize()\n");
+    return 2;
+  }
+  if (threads && pcre2_finder_set_threads(finder, threads) != 0) {
+    fprintf(stderr, "Worker threads are not supported\n");
+    pcre2_finder_cleanup(finder);
+    return 1;
+  }
   //open output
   if (!dstfile)
     dst = stdout;
@@ -190,52 +362,65 @@ int main (int argc, char** argv)
     pcre2_finder_cleanup(finder);
     return 3;
   }
+  //write output without copying (references to input data, replacements and groups are written with writev())
+  if ((sink = pcre2_finder_writev_sink_create(fileno(dst))) == NULL) {
+    fprintf(stderr, "Memory allocation error\n");
+    pcre2_finder_cleanup(finder);
+    return 3;
+  }
   //prepare finder for searching
-  if (pcre2_finder_open(finder, flushsearchdata, dst) != 0) {
+  pcre2_finder_set_stats(finder, showstats);
+  if (pcre2_finder_open(finder, pcre2_finder_output_to_writev, sink) != 0) {
     fprintf(stderr, "Error in pcre2_finder_open()\n");
+    pcre2_finder_writev_sink_destroy(sink);
     pcre2_finder_cleanup(finder);
     return 4;
   }
   //process search data
+  inputdata.finder = finder;
+  inputdata.sink = sink;
+  inputdata.threads = threads;
   if (srctext) {
     //process supplied text
-    if (pcre2_finder_process(finder, srctext, strlen(srctext)) < 0) {
-      fprintf(stderr, "Error in pcre2_finder_process()\n");
-    }
+    process_input(&inputdata, srctext, strlen(srctext));
   } else {
-    //process file (or standard input)
-    FILE* src;
-    char buf[READBUFFERSIZE];
-    size_t buflen;
-    if (!srcfile) {
-      src = stdin;
-    } else {
-      if ((src = fopen(srcfile, "rb")) == NULL) {
-        fprintf(stderr, "Error opening file: %s\n", srcfile);
-        pcre2_finder_cleanup(finder);
-        return 5;
-      }
+    //process file (memory mapped if possible) or standard input
+    if (input_reader_read(srcfile, buffersize, process_input, &inputdata) != 0) {
+      fprintf(stderr, "Error reading file: %s\n", (srcfile ? srcfile : "(standard input)"));
+      pcre2_finder_close(finder);
+      pcre2_finder_writev_sink_destroy(sink);
+      pcre2_finder_cleanup(finder);
+      return 5;
     }
-    while ((buflen = fread(buf, 1, READBUFFERSIZE, src)) > 0) {
-      if (pcre2_finder_process(finder, buf, buflen) < 0) {
-        fprintf(stderr, "Error in pcre2_finder_process()\n");
-      }
-    }
-    fclose(src);
   }
-  pcre2_finder_close(finder);
+  if (pcre2_finder_close(finder) < 0) {
+    fprintf(stderr, "Error in pcre2_finder_close()\n");
+  }
+  if (pcre2_finder_writev_sink_destroy(sink) != 0)
+    fprintf(stderr, "Error writing output\n");
   //show results
   if (verbose) {
     size_t i;
+    for (i = 0; i < patterns; i++)
+      replacedata.count += patterncounts[i];
     if (dst == stdout)
       printf("\n");
     printf("%lu matches replaced\n", (unsigned long)replacedata.count);
     for (i = 0; i < patterns; i++)
       printf("pattern %lu replaced %lu times\n", (unsigned long)i + 1, (unsigned long)patterncounts[i]);
   }
+  if (showstats)
+    show_stats(finder);
   //clean up
   free(patterncounts);
   free(patternreplacements);
+  free(patternlist);
   pcre2_finder_cleanup(finder);
+  {
+    size_t i;
+    for (i = 0; i < patterns; i++)
+      replace_template_free(patterntemplates[i]);
+  }
+  free(patterntemplates);
   return 0;
 }
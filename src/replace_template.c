@@ -0,0 +1,161 @@
+#include "replace_template.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLACE_TEMPLATE_LITERAL -1
+
+struct replace_template_op {
+  int group;
+  size_t offset;
+  size_t len;
+};
+
+struct replace_template_struct {
+  char* text;
+  struct replace_template_op* ops;
+  size_t opcount;
+  int usesgroups;
+  pcre2_code* re;
+  pcre2_match_data* match_data;
+};
+
+static int add_op (struct replace_template_struct* replacetemplate, int group, size_t offset, size_t len)
+{
+  struct replace_template_op* ops;
+  //extend previous literal if it directly precedes this text in the template (not after $$)
+  if (group == REPLACE_TEMPLATE_LITERAL && replacetemplate->opcount && replacetemplate->ops[replacetemplate->opcount - 1].group == REPLACE_TEMPLATE_LITERAL && replacetemplate->ops[replacetemplate->opcount - 1].offset + replacetemplate->ops[replacetemplate->opcount - 1].len == offset) {
+    replacetemplate->ops[replacetemplate->opcount - 1].len += len;
+    return 0;
+  }
+  if ((ops = (struct replace_template_op*)realloc(replacetemplate->ops, (replacetemplate->opcount + 1) * sizeof(struct replace_template_op))) == NULL)
+    return -1;
+  replacetemplate->ops = ops;
+  ops[replacetemplate->opcount].group = group;
+  ops[replacetemplate->opcount].offset = offset;
+  ops[replacetemplate->opcount].len = len;
+  replacetemplate->opcount++;
+  if (group > 0)
+    replacetemplate->usesgroups = 1;
+  return 0;
+}
+
+static int get_group (struct replace_template_struct* replacetemplate, const char* expr, unsigned int flags, const char* name, size_t namelen)
+{
+  char* groupname;
+  int status;
+  PCRE2_SIZE erroroffset;
+  uint32_t capturecount;
+  int group;
+  //group 0 is the whole match and doesn't need the expression
+  if (namelen == 1 && *name == '0')
+    return 0;
+  if (!replacetemplate->re) {
+    if ((replacetemplate->re = pcre2_compile((PCRE2_UCHAR*)expr, PCRE2_ZERO_TERMINATED, flags, &status, &erroroffset, NULL)) == NULL)
+      return -1;
+    if ((replacetemplate->match_data = pcre2_match_data_create_from_pattern(replacetemplate->re, NULL)) == NULL)
+      return -1;
+  }
+  //get group number from name
+  if (*name < '0' || *name > '9') {
+    if ((groupname = (char*)malloc(namelen + 1)) == NULL)
+      return -1;
+    memcpy(groupname, name, namelen);
+    groupname[namelen] = 0;
+    group = pcre2_substring_number_from_name(replacetemplate->re, (PCRE2_SPTR)groupname);
+    free(groupname);
+    return (group > 0 ? group : -1);
+  }
+  group = 0;
+  while (namelen--) {
+    if (*name < '0' || *name > '9' || group > 65535)
+      return -1;
+    group = group * 10 + (*name++ - '0');
+  }
+  pcre2_pattern_info(replacetemplate->re, PCRE2_INFO_CAPTURECOUNT, &capturecount);
+  return (group <= (int)capturecount ? group : -1);
+}
+
+struct replace_template_struct* replace_template_create (const char* replacement, const char* expr, unsigned int flags)
+{
+  struct replace_template_struct* replacetemplate;
+  const char* p;
+  const char* name;
+  size_t namelen;
+  int group;
+  int status = 0;
+  if ((replacetemplate = (struct replace_template_struct*)malloc(sizeof(struct replace_template_struct))) == NULL)
+    return NULL;
+  replacetemplate->ops = NULL;
+  replacetemplate->opcount = 0;
+  replacetemplate->usesgroups = 0;
+  replacetemplate->re = NULL;
+  replacetemplate->match_data = NULL;
+  if ((replacetemplate->text = strdup(replacement)) == NULL) {
+    free(replacetemplate);
+    return NULL;
+  }
+  //split in literal text and group references, a $ that doesn't start a reference is taken literally
+  p = replacement;
+  while (*p && status == 0) {
+    name = NULL;
+    namelen = 0;
+    if (*p == '$' && p[1] == '$') {
+      status = add_op(replacetemplate, REPLACE_TEMPLATE_LITERAL, p + 1 - replacement, 1);
+      p += 2;
+      continue;
+    } else if (*p == '$' && p[1] >= '0' && p[1] <= '9') {
+      name = p + 1;
+      while (name[namelen] >= '0' && name[namelen] <= '9')
+        namelen++;
+    } else if (*p == '$' && p[1] == '{' && strchr(p + 2, '}')) {
+      name = p + 2;
+      namelen = strchr(name, '}') - name;
+    }
+    if (!name || namelen == 0) {
+      status = add_op(replacetemplate, REPLACE_TEMPLATE_LITERAL, p - replacement, 1);
+      p++;
+    } else if ((group = get_group(replacetemplate, expr, flags, name, namelen)) < 0) {
+      status = -1;
+    } else {
+      status = add_op(replacetemplate, group, 0, 0);
+      p = name + namelen + (p[1] == '{' ? 1 : 0);
+    }
+  }
+  if (status != 0) {
+    replace_template_free(replacetemplate);
+    return NULL;
+  }
+  return replacetemplate;
+}
+
+void replace_template_free (struct replace_template_struct* replacetemplate)
+{
+  if (replacetemplate->match_data)
+    pcre2_match_data_free(replacetemplate->match_data);
+  if (replacetemplate->re)
+    pcre2_code_free(replacetemplate->re);
+  free(replacetemplate->ops);
+  free(replacetemplate->text);
+  free(replacetemplate);
+}
+
+void replace_template_output (struct replace_template_struct* replacetemplate, struct pcre2_finder* finder, const char* data, size_t datalen)
+{
+  PCRE2_SIZE* ovector = NULL;
+  int groups = 0;
+  size_t i;
+  //find the groups within the matched data only
+  if (replacetemplate->usesgroups) {
+    if ((groups = pcre2_match(replacetemplate->re, (PCRE2_SPTR)data, datalen, 0, PCRE2_ANCHORED | PCRE2_ENDANCHORED, replacetemplate->match_data, NULL)) > 0)
+      ovector = pcre2_get_ovector_pointer(replacetemplate->match_data);
+  }
+  for (i = 0; i < replacetemplate->opcount; i++) {
+    if (replacetemplate->ops[i].group == REPLACE_TEMPLATE_LITERAL)
+      pcre2_finder_output(finder, replacetemplate->text + replacetemplate->ops[i].offset, replacetemplate->ops[i].len);
+    else if (replacetemplate->ops[i].group == 0)
+      pcre2_finder_output(finder, data, datalen);
+    //groups that didn't take part in the match are left empty
+    else if (replacetemplate->ops[i].group < groups && ovector[2 * replacetemplate->ops[i].group] != PCRE2_UNSET && ovector[2 * replacetemplate->ops[i].group + 1] > ovector[2 * replacetemplate->ops[i].group])
+      pcre2_finder_output(finder, data + ovector[2 * replacetemplate->ops[i].group], ovector[2 * replacetemplate->ops[i].group + 1] - ovector[2 * replacetemplate->ops[i].group]);
+  }
+}
@@ -0,0 +1,29 @@
+#ifndef INCLUDED_REPLACE_TEMPLATE_H
+#define INCLUDED_REPLACE_TEMPLATE_H
+
+#include "pcre2_finder.h"
+
+/* C library for replacement templates with references to capture groups ($1, ${1}, ${name}, $$ for $) */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//data structure
+struct replace_template_struct;
+
+//parse template once for the expression (compiled with the same flags as passed to pcre2_finder_add_expr() only if it references groups)
+//returns NULL on memory allocation error, if the expression doesn't compile or if a referenced group doesn't exist
+struct replace_template_struct* replace_template_create (const char* replacement, const char* expr, unsigned int flags);
+
+//clean up
+void replace_template_free (struct replace_template_struct* replacetemplate);
+
+//output replacement for a match from inside a pcre2_finder_match_fn (groups are found by matching the expression again anchored on the matched data only, so lookbehind and lookahead can't see data before or after the match and a group that depends on them outputs nothing)
+void replace_template_output (struct replace_template_struct* replacetemplate, struct pcre2_finder* finder, const char* data, size_t datalen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_REPLACE_TEMPLATE_H
@@ -0,0 +1,33 @@
+#count matches in periodic data sequentially, split in segments (-j) and split over workers (-r), the counts must be the same
+#run with: cmake -DCOUNT=<path of pcre2_finder_count> -DDATAFILE=<path of file to generate> -P count_segments.cmake
+FUNCTION(WRITE_DATA BLOCKS)
+  SET(BLOCK "x")
+  FOREACH(I RANGE 19)
+    SET(BLOCK "${BLOCK}${BLOCK}")
+  ENDFOREACH()
+  #the length isn't a multiple of the pattern lengths
+  FILE(WRITE "${DATAFILE}" "xxx")
+  FOREACH(I RANGE 1 ${BLOCKS})
+    FILE(APPEND "${DATAFILE}" "${BLOCK}")
+  ENDFOREACH()
+ENDFUNCTION()
+FUNCTION(COMPARE_COUNTS OPTIONS)
+  EXECUTE_PROCESS(COMMAND "${COUNT}" --independent -f "${DATAFILE}" ${ARGN} OUTPUT_VARIABLE EXPECTED RESULT_VARIABLE STATUS)
+  IF(NOT STATUS EQUAL 0 OR NOT EXPECTED MATCHES "pattern 1 found")
+    MESSAGE(FATAL_ERROR "sequential count failed: ${EXPECTED}")
+  ENDIF()
+  FOREACH(OPTION ${OPTIONS})
+    STRING(REPLACE " " ";" OPTION "${OPTION}")
+    EXECUTE_PROCESS(COMMAND "${COUNT}" --independent ${OPTION} "${DATAFILE}" ${ARGN} OUTPUT_VARIABLE RESULT RESULT_VARIABLE STATUS)
+    IF(NOT STATUS EQUAL 0 OR NOT RESULT STREQUAL EXPECTED)
+      MESSAGE(FATAL_ERROR "count with ${OPTION} differs:\n${RESULT}\nexpected:\n${EXPECTED}")
+    ENDIF()
+  ENDFOREACH()
+ENDFUNCTION()
+#split in segments of at least 4 MB
+WRITE_DATA(9)
+COMPARE_COUNTS("-j 2 -f;-j 3 -f" xx xxx)
+#split in items of 16 MB
+WRITE_DATA(32)
+COMPARE_COUNTS("-j 2 -r" "x{5}")
+FILE(REMOVE "${DATAFILE}")
@@ -0,0 +1,164 @@
+#include "pcre2_finder.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+//output of a search, with non-matching data as is and matches as [matchid:match]
+static char result[4096];
+static size_t resultlen = 0;
+
+static int failures = 0;
+
+static void result_append (const char* data, size_t datalen)
+{
+  if (datalen > sizeof(result) - 1 - resultlen)
+    datalen = sizeof(result) - 1 - resultlen;
+  memcpy(result + resultlen, data, datalen);
+  resultlen += datalen;
+  result[resultlen] = 0;
+}
+
+static size_t collect_output (void* callbackdata, const char* data, size_t datalen)
+{
+  if (data)
+    result_append(data, datalen);
+  return datalen;
+}
+
+static int collect_match (struct pcre2_finder* finder, const char* data, size_t datalen, void* callbackdata, int matchid)
+{
+  char id[16];
+  sprintf(id, "[%i:", matchid);
+  result_append(id, strlen(id));
+  result_append(data, datalen);
+  result_append("]", 1);
+  return 0;
+}
+
+//search data passed in chunks of chunksize bytes with the expressions (NULL terminated) and compare the result
+static void check_chunked (int engine, int mode, size_t chunksize, const char* data, const char* expected, va_list exprs)
+{
+  struct pcre2_finder* finder;
+  const char* expr;
+  size_t datalen = strlen(data);
+  size_t pos;
+  int matchid = 0;
+  resultlen = 0;
+  result[0] = 0;
+  if ((finder = pcre2_finder_initialize()) == NULL) {
+    fprintf(stderr, "Memory allocation error\n");
+    exit(2);
+  }
+  pcre2_finder_set_engine(finder, engine);
+  pcre2_finder_set_mode(finder, mode);
+  while ((expr = va_arg(exprs, const char*)) != NULL)
+    pcre2_finder_add_expr(finder, expr, 0, collect_match, NULL, matchid++);
+  if (pcre2_finder_open(finder, collect_output, NULL) != 0) {
+    fprintf(stderr, "Error opening stream\n");
+    failures++;
+  } else {
+    for (pos = 0; pos < datalen; pos += chunksize)
+      pcre2_finder_process(finder, data + pos, (datalen - pos < chunksize ? datalen - pos : chunksize));
+    pcre2_finder_close(finder);
+    if (strcmp(result, expected) != 0) {
+      fprintf(stderr, "%s search in %s mode of \"%s\" in chunks of %lu bytes gives \"%s\" instead of \"%s\"\n", (engine == PCRE2_FINDER_ENGINE_JIT ? "JIT" : "DFA"), (mode == PCRE2_FINDER_MODE_SIMULTANEOUS ? "simultaneous" : "layered"), data, (unsigned long)chunksize, result, expected);
+      failures++;
+    }
+  }
+  pcre2_finder_cleanup(finder);
+}
+
+static void check (int engine, int mode, const char* data, const char* expected, ...)
+{
+  static const size_t chunksizes[] = {1, 2, 3, 1024};
+  size_t i;
+  va_list exprs;
+  for (i = 0; i < sizeof(chunksizes) / sizeof(chunksizes[0]); i++) {
+    va_start(exprs, expected);
+    check_chunked(engine, mode, chunksizes[i], data, expected, exprs);
+    va_end(exprs);
+  }
+}
+
+static void test_match_at_end (int engine, int mode)
+{
+  //greedy matches that are still partial when the data ends
+  check(engine, mode, "xabc", "xa[0:bc]", "b\\w+", NULL);
+  check(engine, mode, "foo=1 bar=22", "[0:foo=1] [0:bar=22]", "\\w+=\\d+", NULL);
+  check(engine, mode, "a1 a12 a123", "[0:a1] [0:a12] [0:a123]", "a\\d+", NULL);
+}
+
+static void test_verbs (int engine)
+{
+  //expressions with their own marks or other backtracking control verbs among combined expressions
+  check(engine, PCRE2_FINDER_MODE_SIMULTANEOUS, "xab c ab", "x[0:ab] [1:c] [0:ab]", "a(*MARK:9)b", "c", NULL);
+  check(engine, PCRE2_FINDER_MODE_SIMULTANEOUS, "xab c ab", "x[1:ab] [0:c] [1:ab]", "c", "a(*PRUNE:x)b", "d", NULL);
+  check(engine, PCRE2_FINDER_MODE_SIMULTANEOUS, "abcab", "[0:a][1:bc][0:a]b", "a(*THEN:1)", "b(*COMMIT)c", NULL);
+}
+
+static int count_match (struct pcre2_finder* finder, const char* data, size_t datalen, void* callbackdata, int matchid)
+{
+  size_t* matchlen = (size_t*)callbackdata;
+  *matchlen = (*matchlen ? (size_t)-1 : datalen);
+  return 0;
+}
+
+static void test_long_partial_match (int engine, int mode)
+{
+  //a match much longer than the blocks it is passed in must not be searched again from its start with each block
+  struct pcre2_finder* finder;
+  struct pcre2_finder_stats stats;
+  char* data;
+  size_t datalen = 100000;
+  size_t matchlen = 0;
+  size_t pos;
+  if ((data = (char*)malloc(datalen)) == NULL || (finder = pcre2_finder_initialize()) == NULL) {
+    fprintf(stderr, "Memory allocation error\n");
+    exit(2);
+  }
+  memset(data, 'y', datalen);
+  memcpy(data + 10, "BEGIN", 5);
+  memcpy(data + datalen - 15, "END", 3);
+  pcre2_finder_set_engine(finder, engine);
+  pcre2_finder_set_mode(finder, mode);
+  pcre2_finder_add_expr(finder, "BEGIN.*?END", 0, count_match, &matchlen, 0);
+  pcre2_finder_set_stats(finder, 1);
+  if (pcre2_finder_open(finder, pcre2_finder_output_to_null, NULL) != 0) {
+    fprintf(stderr, "Error opening stream\n");
+    failures++;
+  } else {
+    for (pos = 0; pos < datalen; pos += 100)
+      pcre2_finder_process(finder, data + pos, 100);
+    pcre2_finder_close(finder);
+    if (matchlen != datalen - 22) {
+      fprintf(stderr, "%s search in %s mode of long match in chunks of 100 bytes found match of %li bytes instead of %lu\n", (engine == PCRE2_FINDER_ENGINE_JIT ? "JIT" : "DFA"), (mode == PCRE2_FINDER_MODE_SIMULTANEOUS ? "simultaneous" : "layered"), (long)matchlen, (unsigned long)(datalen - 22));
+      failures++;
+    }
+    if (pcre2_finder_get_stats(finder, &stats, 1) != 1 || stats.searches > 100) {
+      fprintf(stderr, "%s search in %s mode of long match in chunks of 100 bytes took %lu searches\n", (engine == PCRE2_FINDER_ENGINE_JIT ? "JIT" : "DFA"), (mode == PCRE2_FINDER_MODE_SIMULTANEOUS ? "simultaneous" : "layered"), (unsigned long)stats.searches);
+      failures++;
+    }
+  }
+  pcre2_finder_cleanup(finder);
+  free(data);
+}
+
+int main (int argc, char** argv)
+{
+  //(layered DFA searches report the shortest match, which depends on where the data is split)
+  test_match_at_end(PCRE2_FINDER_ENGINE_JIT, PCRE2_FINDER_MODE_LAYERED);
+  test_match_at_end(PCRE2_FINDER_ENGINE_DFA, PCRE2_FINDER_MODE_SIMULTANEOUS);
+  test_match_at_end(PCRE2_FINDER_ENGINE_JIT, PCRE2_FINDER_MODE_SIMULTANEOUS);
+  test_verbs(PCRE2_FINDER_ENGINE_DFA);
+  test_verbs(PCRE2_FINDER_ENGINE_JIT);
+  //(layered DFA searches resume the partial match instead of searching it again)
+  test_long_partial_match(PCRE2_FINDER_ENGINE_JIT, PCRE2_FINDER_MODE_LAYERED);
+  test_long_partial_match(PCRE2_FINDER_ENGINE_DFA, PCRE2_FINDER_MODE_SIMULTANEOUS);
+  if (failures) {
+    fprintf(stderr, "%i checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,194 @@
+#include "search_data_buffer.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+//all data added to the buffer so far, used as reference
+static char reference[1 << 20];
+static size_t referencelen = 0;
+static unsigned int seed = 12345;
+
+//data received by the flush function
+static char output[1 << 20];
+static size_t outputlen = 0;
+static size_t outputmax = (size_t)-1;
+
+static int failures = 0;
+
+#define CHECK(condition) do { if (!(condition)) { fprintf(stderr, "%s:%i: check failed: %s\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static void add (struct search_data_buffer_struct* buffer, size_t len)
+{
+  size_t i;
+  for (i = 0; i < len; i++) {
+    seed = seed * 1103515245 + 12345;
+    reference[referencelen + i] = (char)(seed >> 16);
+  }
+  search_data_buffer_add(buffer, reference + referencelen, len);
+  referencelen += len;
+}
+
+static size_t collect (void* callbackdata, const char* data, size_t datalen)
+{
+  //accept at most outputmax bytes in total to simulate a failing writer
+  if (datalen > outputmax - outputlen)
+    datalen = outputmax - outputlen;
+  memcpy(output + outputlen, data, datalen);
+  outputlen += datalen;
+  return datalen;
+}
+
+static void reset (struct search_data_buffer_struct* buffer)
+{
+  reset_search_data_buffer(buffer);
+  referencelen = 0;
+  outputlen = 0;
+  outputmax = (size_t)-1;
+}
+
+//check that the buffered data from pos up to the end matches the reference in all the ways it can be accessed
+static void check_buffered (struct search_data_buffer_struct* buffer, size_t pos)
+{
+  const char* data1;
+  const char* data2;
+  size_t len1;
+  size_t len2;
+  size_t len;
+  size_t p;
+  const char* data;
+  CHECK(search_data_buffer_get_pos(buffer) + search_data_buffer_get_len(buffer) == referencelen);
+  //views, repeated while data is spilled to disk
+  for (p = pos; p < referencelen; p += len) {
+    len = search_data_buffer_get_view(buffer, p, &data1, &len1, &data2, &len2);
+    CHECK(len > 0 && len == len1 + len2 && p + len <= referencelen);
+    if (len == 0 || p + len > referencelen)
+      break;
+    CHECK(memcmp(data1, reference + p, len1) == 0);
+    CHECK(len2 == 0 || (data2 && memcmp(data2, reference + p + len1, len2) == 0));
+  }
+  //single block up to the end
+  CHECK((data = search_data_buffer_get_at_pos(buffer, pos)) != NULL);
+  if (data)
+    CHECK(memcmp(data, reference + pos, referencelen - pos) == 0);
+  //out of range
+  CHECK(search_data_buffer_get_at_pos(buffer, referencelen) == NULL);
+  CHECK(search_data_buffer_get_contiguous(buffer, pos, referencelen - pos + 1) == NULL);
+}
+
+static void test_wraparound (struct search_data_buffer_struct* buffer)
+{
+  const char* data1;
+  const char* data2;
+  size_t len1;
+  size_t len2;
+  const char* data;
+  reset(buffer);
+  //fill most of the smallest ring, flush most of it and add data that wraps around the end of the ring
+  add(buffer, 3000);
+  CHECK(search_data_buffer_flush_fn(buffer, 2500, collect, NULL) == 2500);
+  add(buffer, 3000);
+  CHECK(search_data_buffer_get_view(buffer, 2500, &data1, &len1, &data2, &len2) == 3500);
+  CHECK(len1 == 4096 - 2500 && len2 == 3500 - len1 && data2 != NULL);
+  //a range that doesn't wrap is returned in place
+  CHECK((data = search_data_buffer_get_contiguous(buffer, 2600, 100)) == data1 + 100);
+  //a range that wraps is moved to a single block
+  CHECK((data = search_data_buffer_get_contiguous(buffer, 3000, 2000)) != NULL);
+  if (data)
+    CHECK(memcmp(data, reference + 3000, 2000) == 0);
+  check_buffered(buffer, 2500);
+  CHECK(search_data_buffer_flush_remaining_fn(buffer, collect, NULL) == 3500);
+  CHECK(outputlen == referencelen && memcmp(output, reference, outputlen) == 0);
+  CHECK(search_data_buffer_get_len(buffer) == 0);
+}
+
+static void test_growth_while_wrapped (struct search_data_buffer_struct* buffer)
+{
+  reset(buffer);
+  add(buffer, 3000);
+  search_data_buffer_flush_fn(buffer, 2500, collect, NULL);
+  add(buffer, 3000);
+  //grow the ring while the data wraps around its end
+  add(buffer, 2000);
+  add(buffer, 20000);
+  check_buffered(buffer, 2500);
+  check_buffered(buffer, 10000);
+  search_data_buffer_flush_fn(buffer, 10000, collect, NULL);
+  add(buffer, 5000);
+  check_buffered(buffer, 10000);
+  search_data_buffer_flush_remaining_fn(buffer, collect, NULL);
+  CHECK(outputlen == referencelen && memcmp(output, reference, outputlen) == 0);
+}
+
+static void test_spill (struct search_data_buffer_struct* buffer)
+{
+  const char* data;
+  size_t i;
+  size_t len;
+  reset(buffer);
+  search_data_buffer_set_max_memory(buffer, 4096);
+  //spill data beyond the maximum memory size to disk
+  for (i = 0; i < 40; i++)
+    add(buffer, 1000 + i * 37);
+  CHECK(search_data_buffer_get_spilled(buffer) > 0);
+  CHECK(search_data_buffer_get_len(buffer) - search_data_buffer_get_spilled(buffer) <= 4096);
+  //data added at once beyond the maximum memory size
+  add(buffer, 10000);
+  CHECK(search_data_buffer_get_len(buffer) - search_data_buffer_get_spilled(buffer) <= 4096);
+  check_buffered(buffer, 0);
+  check_buffered(buffer, referencelen - search_data_buffer_get_len(buffer) + search_data_buffer_get_spilled(buffer) - 1);
+  //a range from the spilled data into the data in memory
+  i = search_data_buffer_get_spilled(buffer);
+  CHECK((data = search_data_buffer_get_contiguous(buffer, i - 500, 1500)) != NULL);
+  if (data)
+    CHECK(memcmp(data, reference + i - 500, 1500) == 0);
+  //flush within the spilled data, then across the boundary with the data in memory
+  CHECK(search_data_buffer_flush_fn(buffer, 1234, collect, NULL) == 1234);
+  check_buffered(buffer, 1234);
+  i = search_data_buffer_get_pos(buffer) + search_data_buffer_get_spilled(buffer) + 100;
+  CHECK(search_data_buffer_flush_fn(buffer, i, collect, NULL) == i - 1234);
+  CHECK(search_data_buffer_get_spilled(buffer) == 0);
+  check_buffered(buffer, i);
+  //spill again after flushing, with the data in memory at different positions in the ring
+  for (len = 0; len < 100; len++) {
+    add(buffer, 777);
+    CHECK(search_data_buffer_get_spilled(buffer) > 0);
+    check_buffered(buffer, search_data_buffer_get_pos(buffer) + search_data_buffer_get_spilled(buffer) - 10);
+  }
+  check_buffered(buffer, i);
+  CHECK(search_data_buffer_flush_remaining_fn(buffer, collect, NULL) == referencelen - i);
+  CHECK(outputlen == referencelen && memcmp(output, reference, outputlen) == 0);
+  CHECK(search_data_buffer_get_len(buffer) == 0 && search_data_buffer_get_spilled(buffer) == 0);
+  search_data_buffer_set_max_memory(buffer, 0);
+}
+
+static void test_failed_flush (struct search_data_buffer_struct* buffer)
+{
+  reset(buffer);
+  search_data_buffer_set_max_memory(buffer, 4096);
+  add(buffer, 10000);
+  //only the bytes that were written are reported
+  outputmax = 3000;
+  CHECK(search_data_buffer_flush_remaining_fn(buffer, collect, NULL) == 3000);
+  CHECK(memcmp(output, reference, 3000) == 0);
+  search_data_buffer_set_max_memory(buffer, 0);
+}
+
+int main (int argc, char** argv)
+{
+  struct search_data_buffer_struct* buffer;
+  if ((buffer = initialize_search_data_buffer()) == NULL) {
+    fprintf(stderr, "Memory allocation error\n");
+    return 2;
+  }
+  test_wraparound(buffer);
+  test_growth_while_wrapped(buffer);
+  test_spill(buffer);
+  test_failed_flush(buffer);
+  deinitialize_search_data_buffer(buffer);
+  if (failures) {
+    fprintf(stderr, "%i checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}